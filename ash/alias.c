@@ -19,12 +19,10 @@
 
 #include "ash/alias.h"
 #include "ash/ash.h"
+#include "ash/command.h"
+#include "ash/mem.h"
 #include "ash/ops.h"
 #include "ash/unit.h"
-#include "ash/util/hash.h"
-#include "ash/util/map.h"
-
-#define ALIAS_SIZE 1024
 
 static const char *USAGE =
     "alias:\n"
@@ -47,48 +45,38 @@ int ash_alias(int argc, const char * const *argv)
         return ASH_STATUS_OK;
     }
 
-    const char *name, *alias;
-    name = ash_strcpy(argv[1]);
-    alias = ash_strcpy(argv[2]);
-
-    ash_alias_set(alias, name);
+    ash_alias_set(argv[2], ash_strcpy(argv[1]));
 
     return ASH_STATUS_OK;
 }
 
-struct ash_alias {
-    struct map *map;
-};
-
-static struct ash_alias alias = {
-    .map = NULL
-};
-
+/* aliases are stored alongside builtins within the command table */
 const char *ash_alias_get(const char *a)
 {
-    const char *name;
-    name = map_get(alias.map, (key_t *)a);
-    return name;
+    struct ash_command_entry *entry;
+    entry = ash_command_lookup(a);
+    return (entry) ? entry->alias: NULL;
 }
 
 void ash_alias_set(const char *a, const char *name)
 {
-    return map_insert(alias.map, (key_t *)a, (void *)name);
+    struct ash_command_entry *entry;
+    entry = ash_command_intern(a);
+    if (entry->alias)
+        ash_free((char *)entry->alias);
+    entry->alias = name;
 }
 
 void ash_alias_unset(const char *a)
 {
-    map_remove(alias.map, (key_t *)a);
-}
-
-static void init(void)
-{
-    struct hashmeta meta;
-    hash_meta_string_init(&meta, ALIAS_SIZE);
-    alias.map = map_new(meta);
+    struct ash_command_entry *entry;
+    if ((entry = ash_command_lookup(a)) && entry->alias) {
+        ash_free((char *)entry->alias);
+        entry->alias = NULL;
+    }
 }
 
 const struct ash_unit_module ash_module_alias = {
-    .init = init,
+    .init = NULL,
     .destroy = NULL
 };
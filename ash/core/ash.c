@@ -26,9 +26,12 @@
 #include "ash/io.h"
 #include "ash/macro.h"
 #include "ash/ops.h"
+#include "ash/prof.h"
 #include "ash/script.h"
 #include "ash/session.h"
+#include "ash/startup.h"
 #include "ash/str.h"
+#include "ash/trace.h"
 #include "ash/tuple.h"
 #include "ash/type.h"
 #include "ash/var.h"
@@ -84,8 +87,45 @@ static void ash_option_invalid(const char *s)
     ash_exit_fail();
 }
 
-static void ash_option_long(const char *s)
+static void option_profile(const char *path)
 {
+    if (!path) {
+        ash_print(PNAME ": option `--%s` requires a file.\n",
+                  ASH_PROF_OPTION);
+        ash_exit_fail();
+    }
+    ash_prof_start(path);
+}
+
+static void option_trace(const char *target)
+{
+    if (!target) {
+        ash_print(PNAME ": option `--%s` requires a descriptor or file.\n",
+                  ASH_TRACE_OPTION);
+        ash_exit_fail();
+    }
+    if (ash_trace_start(target) == -1) {
+        ash_print(PNAME ": error: unable to trace to `%s`.\n", target);
+        ash_exit_fail();
+    }
+}
+
+static void ash_option_long(struct queue *opt, const char *s)
+{
+    /* already enabled before the shell was initialized */
+    if (!strcmp(s, ASH_STARTUP_TRACE))
+        return;
+
+    if (!strcmp(s, ASH_PROF_OPTION)) {
+        option_profile(queue_dequeue(opt));
+        return;
+    }
+
+    if (!strcmp(s, ASH_TRACE_OPTION)) {
+        option_trace(queue_dequeue(opt));
+        return;
+    }
+
     if (!(*s))
         ash_option_none();
     else if (!strcmp(s, "build"))
@@ -103,6 +143,7 @@ static void ash_option_long(const char *s)
 static void option_command(const char *command)
 {
     struct input input;
+    ash_startup_done();
     input_text_init(&input, command);
     ash_main_input(&input);
 }
@@ -141,6 +182,10 @@ static void ash_option_short(struct queue *opt, char c)
             ash_io_silent(true);
             break;
 
+        case 'u':
+            ash_io_unbuffered(true);
+            break;
+
         case 'h':
             ash_print_help();
             ash_logout();
@@ -198,6 +243,9 @@ script(struct queue *opt, const char *name)
     session = ash_session_default();
     ash_session_set_script(session);
 
+    ash_startup_phase("script");
+    ash_startup_done();
+
     if (ash_session_entry(session))
         ash_script_exec_entry(script, ash_tuple_from(1, &args));
     else
@@ -217,7 +265,7 @@ option(struct queue *opt)
 
         if (o[0] == '-') {
             if (o[1] == '-')
-                ash_option_long(&o[2]);
+                ash_option_long(opt, &o[2]);
             else if (strlen(&o[1]) == 1)
                 ash_option_short(opt, o[1]);
             else
@@ -243,11 +291,15 @@ void ash_print_help(void)
     ash_print("    -e                 Begin execution from `main` function\n");
     ash_print("    -p                 Do not read profile\n");
     ash_print("    -s                 Silent output\n");
+    ash_print("    -u                 Unbuffered output\n");
     ash_print("    -h, --help         Print this message\n");
     ash_print("    -v, --version      Print version info\n");
+    ash_print("    --startup-trace    Print the time of each startup phase\n");
     ash_print("\n");
     ash_print("OPTIONS:\n");
     ash_print("    -c <COMMAND>       Execute a command\n");
+    ash_print("    --profile <FILE>   Write a sampled profile of the script\n");
+    ash_print("    --xtrace <FD>      Trace each command and call to FD or a file\n");
     ash_print("\n");
     ash_print("INPUT:\n");
     ash_print("    <SCRIPT>           Shell script to execute\n");
@@ -260,8 +312,27 @@ static void ash_set_static_var(const char *id, const char *str)
     ash_var_set(ash_strcpy(id), obj);
 }
 
+/* the trace is enabled before any option is handled */
+static void startup_trace(int argc, const char *argv[])
+{
+    for (int i = 1; i < argc && argv[i][0] == '-'; ++i) {
+        if (argv[i][1] == '-' && !strcmp(&argv[i][2], ASH_STARTUP_TRACE)) {
+            ash_startup_trace();
+            return;
+        }
+        /* the rest are the arguments of a command */
+        if (!strcmp(argv[i], "-c"))
+            return;
+        if (!strcmp(argv[i], "--" ASH_PROF_OPTION) ||
+            !strcmp(argv[i], "--" ASH_TRACE_OPTION))
+            ++i;
+    }
+}
+
 int main(int argc, const char *argv[])
 {
+    startup_trace(argc, argv);
+
     /* initialize the shell */
     ash_unit_init();
 
@@ -271,6 +342,7 @@ int main(int argc, const char *argv[])
     session = ash_session_default();
     ash_session_meta_init(&meta, argv[0]);
     ash_session_init(session, &meta);
+    ash_startup_phase("session");
 
     /* set default variables */
     ash_set_static_var("0", argv[0]);
@@ -279,6 +351,7 @@ int main(int argc, const char *argv[])
     ash_set_static_var("ASH_MAJOR", ASH_VERSION_MAJOR);
     ash_set_static_var("ASH_MINOR", ASH_VERSION_MINOR);
     ash_set_static_var("ASH_MICRO", ASH_VERSION_MICRO);
+    ash_startup_phase("vars");
 
     if (argc > 1) {
         struct queue *opt;
@@ -292,6 +365,8 @@ int main(int argc, const char *argv[])
     }
 
     ash_session_start(session);
+    ash_startup_phase("profile");
+    ash_startup_done();
     ash_main();
 
     return EXIT_SUCCESS;
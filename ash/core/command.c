@@ -14,8 +14,12 @@
    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+/* strchrnul */
+#define _GNU_SOURCE
+
 #include <assert.h>
 #include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -34,17 +38,24 @@
 #include "ash/history.h"
 #include "ash/io.h"
 #include "ash/list.h"
+#include "ash/mem.h"
 #include "ash/ops.h"
+#include "ash/parallel.h"
 #include "ash/rand.h"
 #include "ash/read.h"
 #include "ash/sleep.h"
 #include "ash/source.h"
 #include "ash/type.h"
 #include "ash/typeof.h"
+#include "ash/unit.h"
 #include "ash/unset.h"
 #include "ash/var.h"
 #include "ash/lang/runtime.h"
 
+#ifdef ASH_PLATFORM_POSIX
+    #include <unistd.h>
+#endif
+
 struct ash_command {
     enum ash_command_name command;
     const char *name;
@@ -134,6 +145,14 @@ static struct ash_command commands[ ASH_COMMAND_NO ] = {
         .usage   = ash_list_usage
     },
 
+    [ ASH_COMMAND_PARALLEL ] = {
+        .command = ASH_COMMAND_PARALLEL,
+        .name    = "parallel",
+        .main    = NULL,
+        .main_env = ash_parallel_env,
+        .usage   = ash_parallel_usage
+    },
+
     [ ASH_COMMAND_RAND ] = {
         .command = ASH_COMMAND_RAND,
         .name    = "rand",
@@ -211,131 +230,248 @@ void ash_command_usage(enum ash_command_name command)
     }
 }
 
-enum ash_command_name ash_command_find(const char *v)
+/* initial number of slots within the command table, a power of two */
+#define ASH_COMMAND_TABLE_SIZE 64
+/* longest path that may be cached for a command */
+#define ASH_COMMAND_PATH_MAX 4096
+
+/*
+every name the shell dispatches on is interned in a single open
+addressing table. the seed of the hash is chosen such that each
+builtin occupies its home slot, so a builtin is always found on the
+first probe, while aliases and cached paths share the same entry.
+*/
+struct ash_command_table {
+    uint32_t seed;
+    size_t size;
+    size_t length;
+    struct ash_command_entry **slots;
+    /* the value of PATH when paths were last cached */
+    char *path;
+};
+
+static struct ash_command_table table = {
+    .seed = 0,
+    .size = 0,
+    .length = 0,
+    .slots = NULL,
+    .path = NULL
+};
+
+/* FNV-1a with the offset basis perturbed by the seed */
+static inline uint32_t ash_command_hash(const char *s, uint32_t seed)
+{
+    uint32_t hash = 2166136261u ^ seed;
+    while (*s) {
+        hash ^= (unsigned char) *(s++);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* find a seed where no two builtins share a home slot */
+static uint32_t ash_command_table_seed(size_t size)
+{
+    bool used[size];
+    size_t mask = size - 1, i;
+    uint32_t seed = 0;
+
+    for (;; ++seed) {
+        memset(used, 0, sizeof used);
+        for (i = 0; i < ASH_COMMAND_NO; ++i) {
+            size_t slot = ash_command_hash(commands[i].name, seed) & mask;
+            if (used[slot])
+                break;
+            used[slot] = true;
+        }
+        if (i == ASH_COMMAND_NO)
+            return seed;
+    }
+}
+
+static void
+ash_command_table_place(struct ash_command_table *table,
+                        struct ash_command_entry *entry)
 {
-    switch (v[0]) {
-        case 'a':
-            if (v[1] == 'l' &&
-                v[2] == 'i' &&
-                v[3] == 'a' &&
-                v[4] == 's' &&
-                !v[5])
-                return ASH_COMMAND_ALIAS;
-            break;
-
-        case 'c':
-            if (v[1] == 'd' &&
-                !(v[2]))
-                return ASH_COMMAND_CD;
-            break;
-
-        case 'd':
-            if (v[1] == 'e' &&
-                v[2] == 'f' &&
-                v[3] == 'i' &&
-                v[4] == 'n' &&
-                v[5] == 'e' &&
-                v[6] == 'd' &&
-                !v[7])
-                return ASH_COMMAND_DEFINED;
-            break;
-
-        case 'e':
-            if (v[1] == 'x') {
-                if (v[2] == 'e' &&
-                    v[3] == 'c' &&
-                    !v[4])
-                    return ASH_COMMAND_EXEC;
-
-                else if (v[2] == 'i' &&
-                         v[3] == 't' &&
-                         !(v[4]))
-                    return ASH_COMMAND_EXIT;
-
-                else if (v[2] == 'p' &&
-                         v[3] == 'o' &&
-                         v[4] == 'r' &&
-                         v[5] == 't' &&
-                         !v[6])
-                    return ASH_COMMAND_EXPORT;
-            }
-            else if (v[1] == 'c' &&
-                     v[2] == 'h' &&
-                     v[3] == 'o' &&
-                     !(v[4]))
-                return ASH_COMMAND_ECHO;
-            break;
-
-        case 'h':
-            if (v[1] == 'e' &&
-                v[2] == 'l' &&
-                v[3] == 'p' &&
-                !(v[4]))
-                return ASH_COMMAND_HELP;
-            else if (v[1] == 'i' &&
-                     v[2] == 's' &&
-                     v[3] == 't' &&
-                     v[4] == 'o' &&
-                     v[5] == 'r' &&
-                     v[6] == 'y' &&
-                     !v[7])
-                return ASH_COMMAND_HISTORY;
-            break;
-
-        case 'l':
-            if (v[1] == 'i' &&
-                v[2] == 's' &&
-                v[3] == 't')
-                return ASH_COMMAND_LIST;
-            break;
-
-        case 'r':
-            if (v[1] == 'a' &&
-                v[2] == 'n' &&
-                v[3] == 'd' &&
-                !v[4])
-                return ASH_COMMAND_RAND;
-            else if (v[1] == 'e' &&
-                     v[2] == 'a' &&
-                     v[3] == 'd' &&
-                     !v[4])
-                return ASH_COMMAND_READ;
-            break;
-
-        case 's':
-            if (v[1] == 'l' &&
-                v[2] == 'e' &&
-                v[3] == 'e' &&
-                v[4] == 'p' &&
-                !(v[5]))
-                return ASH_COMMAND_SLEEP;
-            else if (v[1] == 'o' &&
-                     v[2] == 'u' &&
-                     v[3] == 'r' &&
-                     v[4] == 'c' &&
-                     v[5] == 'e' &&
-                     !v[6])
-                return ASH_COMMAND_SOURCE;
-            break;
-
-        case 't':
-            if (v[1] == 'y' &&
-                v[2] == 'p' &&
-                v[3] == 'e' &&
-                v[4] == 'o' &&
-                v[5] == 'f' &&
-                !v[6])
-                return ASH_COMMAND_TYPEOF;
-            break;
-
-        case 'u':
-            if (v[1] == 'n' &&
-                v[2] == 's' &&
-                v[3] == 'e' &&
-                v[4] == 't' &&
-                !v[5])
-                return ASH_COMMAND_UNSET;
+    size_t mask = table->size - 1, i;
+
+    entry->hash = ash_command_hash(entry->name, table->seed);
+    for (i = entry->hash & mask; table->slots[i]; i = (i + 1) & mask)
+        ;
+    table->slots[i] = entry;
+}
+
+static void ash_command_table_resize(struct ash_command_table *table,
+                                     size_t size)
+{
+    size_t old;
+    struct ash_command_entry **slots;
+
+    old = table->size;
+    slots = table->slots;
+
+    table->size = size;
+    table->seed = ash_command_table_seed(size);
+    table->slots = ash_alloc(size * sizeof *table->slots);
+    memset(table->slots, 0, size * sizeof *table->slots);
+
+    /* builtins are placed first so they keep their home slots */
+    for (size_t i = 0; i < old; ++i) {
+        if (slots[i] && ash_command_valid(slots[i]->command))
+            ash_command_table_place(table, slots[i]);
     }
 
+    for (size_t i = 0; i < old; ++i) {
+        if (slots[i] && !ash_command_valid(slots[i]->command))
+            ash_command_table_place(table, slots[i]);
+    }
+
+    if (slots)
+        ash_free(slots);
+}
+
+struct ash_command_entry *ash_command_lookup(const char *name)
+{
+    uint32_t hash;
+    size_t mask, i;
+    struct ash_command_entry *entry;
+
+    hash = ash_command_hash(name, table.seed);
+    mask = table.size - 1;
+
+    for (i = hash & mask; (entry = table.slots[i]); i = (i + 1) & mask) {
+        if (entry->hash == hash && strcmp(entry->name, name) == 0)
+            return entry;
+    }
+
+    return NULL;
+}
+
+struct ash_command_entry *ash_command_intern(const char *name)
+{
+    struct ash_command_entry *entry;
+
+    if ((entry = ash_command_lookup(name)))
+        return entry;
+
+    /* keep the table at most half full */
+    if ((table.length + 1) * 2 > table.size)
+        ash_command_table_resize(&table, table.size * 2);
+
+    entry = ash_alloc(sizeof *entry);
+    entry->name = ash_strcpy(name);
+    entry->command = ASH_ERR_COMMAND;
+    entry->alias = NULL;
+    entry->path = NULL;
+
+    ash_command_table_place(&table, entry);
+    table.length++;
+    return entry;
+}
+
+enum ash_command_name ash_command_find(const char *name)
+{
+    struct ash_command_entry *entry;
+
+    if ((entry = ash_command_lookup(name)))
+        return entry->command;
     return ASH_ERR_COMMAND;
 }
+
+enum ash_command_name ash_command_resolve(const char **name)
+{
+    struct ash_command_entry *entry;
+
+    if (!(entry = ash_command_lookup(*name)))
+        return ASH_ERR_COMMAND;
+
+    if (entry->alias) {
+        *name = entry->alias;
+        return ash_command_find(entry->alias);
+    }
+
+    return entry->command;
+}
+
+/* forget every cached path once PATH has been changed */
+static void ash_command_path_check(struct ash_command_table *table)
+{
+    const char *path;
+
+    path = getenv("PATH");
+    if (table->path && path && strcmp(table->path, path) == 0)
+        return;
+
+    for (size_t i = 0; i < table->size; ++i) {
+        struct ash_command_entry *entry = table->slots[i];
+        if (entry && entry->path) {
+            ash_free((char *)entry->path);
+            entry->path = NULL;
+        }
+    }
+
+    if (table->path)
+        ash_free(table->path);
+    table->path = (path) ? (char *)ash_strcpy(path): NULL;
+}
+
+const char *ash_command_path(const char *name)
+{
+    size_t len;
+    const char *dir, *end;
+    char buffer[ASH_COMMAND_PATH_MAX];
+    struct ash_command_entry *entry;
+
+    if (strchr(name, '/'))
+        return NULL;
+
+    ash_command_path_check(&table);
+    entry = ash_command_intern(name);
+    if (entry->path || !table.path)
+        return entry->path;
+
+    for (dir = table.path; *dir; dir = (*end) ? end + 1: end) {
+        end = strchrnul(dir, ':');
+        len = (end == dir) ? 1: (size_t)(end - dir);
+        if (len + strlen(name) + 2 > sizeof buffer)
+            continue;
+
+        if (end == dir)
+            strcpy(buffer, ".");
+        else
+            memcpy(buffer, dir, len), buffer[len] = '\0';
+        strcat(buffer, "/");
+        strcat(buffer, name);
+
+        if (access(buffer, X_OK) == 0)
+            return (entry->path = ash_strcpy(buffer));
+    }
+
+    return NULL;
+}
+
+void ash_command_path_forget(const char *name)
+{
+    struct ash_command_entry *entry;
+
+    if ((entry = ash_command_lookup(name)) && entry->path) {
+        ash_free((char *)entry->path);
+        entry->path = NULL;
+    }
+}
+
+static void init(void)
+{
+    struct ash_command_entry *entry;
+
+    ash_command_table_resize(&table, ASH_COMMAND_TABLE_SIZE);
+    for (size_t i = 0; i < ASH_COMMAND_NO; ++i) {
+        entry = ash_command_intern(commands[i].name);
+        entry->command = commands[i].command;
+    }
+}
+
+const struct ash_unit_module ash_module_command = {
+    .init = init,
+    .destroy = NULL
+};
@@ -16,7 +16,9 @@
 
 
 #include <assert.h>
+#include <errno.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -80,18 +82,28 @@
 
 /* global env variables */
 
+/*
+the values that need a lookup of the user database, the host
+name or the filesystem limits are only found when first used,
+as most scripts and commands never use them
+*/
+
 /* full path of the pwd */
 static char *pwd = NULL;
-/* the default max pwd size */
-static size_t pwd_size = DEFAULT_PATH_SIZE;
+/* the size of the pwd buffer */
+static size_t pwd_size = 0;
+/* the max pwd size, 0 until known */
+static size_t pwd_max = 0;
 /* the current directory */
 static char *dir = NULL;
+/* if `dir` is the current directory of `pwd` */
+static bool dir_valid = false;
 /* the user home directory  */
 static const char *home = NULL;
 /* the username/logname */
-static const char *uname = DEFAULT_UNAME;
+static const char *uname = NULL;
 /* system hostname */
-static const char *host = DEFAULT_HOST;
+static char *host = NULL;
 /* the paths of the current shell env */
 static const char *path = NULL;
 /* the user default shell  */
@@ -137,14 +149,27 @@ ash_getuid(void)
     ash_var_set(ASH_ENV_ROOT, ash_bool_from(root));
 }
 
-static void ash_default_greeter(void);
-
-/* ash greeter */
-static struct ash_obj *greeter;
+/* the default ash greeter */
+static const char acorn[] =
+"        $$$      \n"
+"         $$      \n"
+"       $$$$$$    \n"
+"     $$$$$$$$$$  \n"
+"    $$$oooooo$$$ \n"
+"    $$oooooooo$$ \n"
+"     $oooooooo$  \n"
+"      oooooooo   \n"
+"        oooo     \n"
+"\n";
 
 const char *ash_env_get_greeter(void)
 {
-    return ash_str_get(greeter);
+    return acorn;
+}
+
+static struct ash_obj *ash_default_greeter(void)
+{
+    return ash_str_from(acorn);
 }
 
 /* primary command prompt */
@@ -173,14 +198,37 @@ struct ash_env_set {
     const char *value;
 };
 
+static struct ash_obj *ash_env_lazy_host(void)
+{
+    return ash_str_from(ash_env_get_host());
+}
+
+static struct ash_obj *ash_env_lazy_uname(void)
+{
+    return ash_str_from(ash_env_get_uname());
+}
+
+static struct ash_obj *ash_env_lazy_home(void)
+{
+    return ash_str_from(ash_env_get_home());
+}
+
+struct ash_env_lazy {
+    const char *id;
+    ash_var_lazy value;
+};
+
 static void ash_env_set_vars(void)
 {
+    struct ash_env_lazy lazy[] = {
+        { ASH_ENV_HOST,    ash_env_lazy_host   },
+        { ASH_ENV_LOGNAME, ash_env_lazy_uname  },
+        { ASH_ENV_HOME,    ash_env_lazy_home   },
+        { ASH_ENV_GREETER, ash_default_greeter }
+    };
+
     struct ash_env_set vars[] = {
-        { ASH_ENV_HOST,    host  },
         { ASH_ENV_PATH,    path  },
-        { ASH_ENV_PWD,     pwd   },
-        { ASH_ENV_LOGNAME, uname },
-        { ASH_ENV_HOME,    home  },
         { ASH_ENV_LANG,    lang  },
         { ASH_ENV_MAIL,    mail  },
         { ASH_ENV_SHELL,   shell },
@@ -188,78 +236,237 @@ static void ash_env_set_vars(void)
         { "_OS_FAMILY_", ASH_ENV_OS_FAMILY }
     };
 
+    for (size_t i = 0; i < array_length(lazy); ++i)
+        ash_var_set_lazy(lazy[i].id, lazy[i].value);
+
     for (size_t i = 0; i < array_length(vars); ++i)
         ash_env_set_var(vars[i].id, vars[i].value);
 }
 
-struct ash_prompt_fmt {
-    const char *p1;
-    const char *fmt;
+/*
+the primary prompt is compiled into a list of segments when
+`_ps1_` changes, and rendered into a buffer only when one of
+the values it shows has changed; otherwise the text of the
+previous prompt is reused
+*/
+enum prompt_segment_type {
+    PROMPT_TEXT,
+    PROMPT_COUNT,
+    PROMPT_USER,
+    PROMPT_HOST,
+    PROMPT_PWD,
+    PROMPT_DIR,
+    PROMPT_ROOT
+};
+
+struct prompt_segment {
+    enum prompt_segment_type type;
+    /* a view of the template for text segments */
+    const char *text;
+    size_t len;
 };
 
-void ash_prompt(void)
+struct prompt_template {
+    char *source;
+    struct prompt_segment *segments;
+    size_t len;
+    /* the command count changes with every prompt */
+    bool count;
+    bool dirty;
+    char *buf;
+    size_t size;
+};
+
+static struct prompt_template prompt = {
+    .source = NULL,
+    .segments = NULL,
+    .len = 0,
+    .count = false,
+    .dirty = true,
+    .buf = NULL,
+    .size = 0
+};
+
+static inline void prompt_invalidate(void)
+{
+    prompt.dirty = true;
+}
+
+static void prompt_segment_add(struct prompt_template *pt,
+                               enum prompt_segment_type type,
+                               const char *text, size_t len)
+{
+    struct prompt_segment *last;
+
+    /* adjacent text is kept as one segment */
+    if (type == PROMPT_TEXT && pt->len > 0) {
+        last = &pt->segments[pt->len - 1];
+        if (last->type == PROMPT_TEXT && last->text + last->len == text) {
+            last->len += len;
+            return;
+        }
+    }
+
+    pt->segments[pt->len].type = type;
+    pt->segments[pt->len].text = text;
+    pt->segments[pt->len].len = len;
+    pt->len++;
+}
+
+static void prompt_compile(struct prompt_template *pt, const char *fmt)
+{
+    const char *s;
+    size_t len;
+
+    if (pt->source)
+        ash_free(pt->source);
+    if (pt->segments)
+        ash_free(pt->segments);
+
+    len = strlen(fmt);
+    pt->source = (char *) ash_strcpy(fmt);
+    pt->segments = ash_alloc((len + 1) * sizeof *pt->segments);
+    pt->len = 0;
+    pt->count = false;
+    pt->dirty = true;
+
+    for (s = pt->source; *s; ++s) {
+        if (*s != '\\') {
+            prompt_segment_add(pt, PROMPT_TEXT, s, 1);
+            continue;
+        }
+
+        switch (s[1]) {
+            case '#':
+                prompt_segment_add(pt, PROMPT_COUNT, NULL, 0);
+                pt->count = true;
+                break;
+
+            case 'n':
+                prompt_segment_add(pt, PROMPT_TEXT, "\n", 1);
+                break;
+
+            case 'r':
+                prompt_segment_add(pt, PROMPT_TEXT, "\r", 1);
+                break;
+
+            case 'u':
+                prompt_segment_add(pt, PROMPT_USER, NULL, 0);
+                break;
+
+            case 'h':
+                prompt_segment_add(pt, PROMPT_HOST, NULL, 0);
+                break;
+
+            case 'w':
+                prompt_segment_add(pt, PROMPT_PWD, NULL, 0);
+                break;
+
+            case 'W':
+                prompt_segment_add(pt, PROMPT_DIR, NULL, 0);
+                break;
+
+            case '$':
+                prompt_segment_add(pt, PROMPT_ROOT, NULL, 0);
+                break;
+
+            default:
+                prompt_segment_add(pt, PROMPT_TEXT, s, 1);
+                continue;
+        }
+        ++s;
+    }
+}
+
+static void prompt_append(struct prompt_template *pt, size_t *pos,
+                          const char *text, size_t len)
+{
+    if (*pos + len + 1 > pt->size) {
+        pt->size = (*pos + len + 1) * 2;
+        pt->buf = (pt->buf) ? ash_realloc(pt->buf, pt->size):
+                              ash_alloc(pt->size);
+    }
+
+    memcpy(pt->buf + *pos, text, len);
+    *pos += len;
+}
+
+static void prompt_render(struct prompt_template *pt)
+{
+    char num[32];
+    const char *text;
+    size_t pos = 0, len;
+    struct prompt_segment *seg;
+
+    for (size_t i = 0; i < pt->len; ++i) {
+        seg = &pt->segments[i];
+        text = NULL;
+
+        switch (seg->type) {
+            case PROMPT_TEXT:
+                prompt_append(pt, &pos, seg->text, seg->len);
+                break;
+
+            case PROMPT_COUNT:
+                len = snprintf(num, sizeof num, "%lu", count);
+                prompt_append(pt, &pos, num, len);
+                break;
+
+            case PROMPT_USER:
+                text = ash_env_get_uname();
+                break;
+
+            case PROMPT_HOST:
+                text = ash_env_get_host();
+                break;
+
+            case PROMPT_PWD:
+                text = ash_env_get_pwd();
+                break;
+
+            case PROMPT_DIR:
+                text = ash_env_get_dir();
+                break;
+
+            case PROMPT_ROOT:
+                num[0] = root ? DEFAULT_ROOT: DEFAULT_USER;
+                prompt_append(pt, &pos, num, 1);
+                break;
+        }
+
+        if (text)
+            prompt_append(pt, &pos, text, strlen(text));
+    }
+
+    prompt_append(pt, &pos, "", 0);
+    pt->buf[pos] = '\0';
+    pt->dirty = false;
+}
+
+const char *ash_prompt(void)
 {
-    char c;
     const char *fmt;
     ps1 = ash_var_obj(ash_var_get(ASH_ENV_P1));
     if (!ps1 || !(fmt = ash_str_get(ps1)))
-        return;
-
-    while ((c = *(fmt++))) {
-        if (c == '\\') {
-            c = *fmt;
-            switch (c) {
-                case '#':
-                    ash_print("%lu", count);
-                    break;
-
-                case 'n':
-                    ash_putchar('\n');
-                    break;
-
-                case 'r':
-                    ash_putchar('\r');
-                    break;
-
-                case 'u':
-                    ash_print(ash_env_get_uname());
-                    break;
-
-                case 'h':
-                    ash_print(ash_env_get_host());
-                    break;
-
-                case 'w':
-                    ash_print(ash_env_get_pwd());
-                    break;
-
-                case 'W':
-                    ash_print(ash_env_get_dir());
-                    break;
-
-                case '$':
-                    ash_putchar(root ? DEFAULT_ROOT: DEFAULT_USER);
-                    break;
-
-                default:
-                    ash_putchar('\\');
-                    continue;
-            }
-            fmt++;
-        } else
-            ash_putchar(c);
-    }
+        return "";
+
+    if (!prompt.source || strcmp(prompt.source, fmt))
+        prompt_compile(&prompt, fmt);
+    if (prompt.dirty || prompt.count)
+        prompt_render(&prompt);
 
     ++count;
+    return prompt.buf;
 }
 
-void ash_prompt_next(void)
+const char *ash_prompt_next(void)
 {
     const char *fmt;
     ps2 = ash_var_obj(ash_var_get(ASH_ENV_P2));
 
-    if (!ps2 || (fmt = ash_str_get(ps2)))
-        ash_print("%s", fmt);
+    if (!ps2 || !(fmt = ash_str_get(ps2)))
+        return DEFAULT_P2;
+    return fmt;
 }
 
 const char *ash_env_get_pwd(void)
@@ -269,27 +476,46 @@ const char *ash_env_get_pwd(void)
 
 size_t ash_env_get_pwd_max(void)
 {
-    return pwd_size ? pwd_size: DEFAULT_PATH_SIZE;
+    long max;
+    if (!pwd_max) {
+        max = pathconf(".", _PC_PATH_MAX);
+        pwd_max = (max > 0) ? (size_t) max: DEFAULT_PATH_SIZE;
+    }
+    return pwd_max;
 }
 
 const char *ash_env_get_dir(void)
 {
+    if (!dir_valid)
+        ash_env_dir();
     return dir ? dir: DEFAULT_DIR;
 }
 
+/* the entry is copied, later lookups overwrite it */
 const char *ash_env_get_home(void)
 {
+    const struct passwd *pw;
+    if (!home && (pw = getpwuid(uid)))
+        home = ash_strcpy(pw->pw_dir);
     return home ? home: DEFAULT_HOME;
 }
 
 const char *ash_env_get_uname(void)
 {
+    const struct passwd *pw;
+    if (!uname && (pw = getpwuid(uid)))
+        uname = ash_strcpy(pw->pw_name);
     return uname ? uname: DEFAULT_UNAME;
 }
 
 const char *ash_env_get_host(void)
 {
-    return host ? host: DEFAULT_HOST;
+    if (!host) {
+        host = ash_zalloc((sizeof *host) * MAX_HOST_SIZE);
+        if (gethostname(host, MAX_HOST_SIZE - 1) == -1)
+            strcpy(host, DEFAULT_HOST);
+    }
+    return host;
 }
 
 const char *ash_env_get_path(void)
@@ -297,17 +523,41 @@ const char *ash_env_get_path(void)
     return path ? path: "";
 }
 
+/* read the working directory, growing the buffer as it needs */
+static void ash_env_getcwd(void)
+{
+    if (!pwd) {
+        pwd_size = DEFAULT_PATH_SIZE;
+        pwd = ash_alloc((sizeof *pwd) * pwd_size);
+    }
+
+    while (!getcwd(pwd, pwd_size)) {
+        if (errno != ERANGE) {
+            *pwd = '\0';
+            return;
+        }
+        pwd_size *= 2;
+        pwd = ash_realloc(pwd, (sizeof *pwd) * pwd_size);
+    }
+}
+
 void ash_env_pwd(void)
 {
-    pwd = getcwd(pwd, pwd_size);
+    ash_env_getcwd();
     ash_env_set_var(ASH_ENV_PWD, pwd);
-    ash_env_dir();
+    dir_valid = false;
     setenv(ASH_ENV_PWD, pwd, 1);
+    prompt_invalidate();
 }
 
 void ash_env_dir(void)
 {
-    if (home && pwd) {
+    const char *home;
+
+    dir_valid = true;
+    home = ash_env_get_home();
+
+    if (*home && pwd) {
         if (!strcmp(home, pwd)) {
             dir = ASH_HOME_DIR;
             return;
@@ -328,25 +578,6 @@ void ash_env_dir(void)
     dir = NULL;
 }
 
-static void ash_uname_host(void)
-{
-    uname = getpwuid(getuid())->pw_name;
-    if (host)
-        gethostname((char *)host, MAX_HOST_SIZE);
-}
-
-static void ash_env_set_var_home(void)
-{
-    home = getpwuid(getuid())->pw_dir;
-}
-
-static void ash_env_var_alloc(void)
-{
-    pwd_size = pathconf(".", _PC_PATH_MAX);
-    pwd = ash_alloc((sizeof *pwd) * pwd_size);
-    host = ash_alloc((sizeof *host) * MAX_HOST_SIZE);
-}
-
 static void ash_env_set_util(void)
 {
     ash_var_set("_RAND_MAX_", ash_int_from(RAND_MAX));
@@ -354,24 +585,16 @@ static void ash_env_set_util(void)
 
 static void ash_env_vars(void)
 {
-    greeter = ash_str_new();
-    ash_default_greeter();
-
-    ash_env_var_alloc();
     ash_env_pwd();
-    ash_uname_host();
 
     shell = getenv(ASH_ENV_SHELL);
     path  = getenv(ASH_ENV_PATH);
     lang  = getenv(ASH_ENV_LANG);
     mail  = getenv(ASH_ENV_MAIL);
     home  = getenv(ASH_ENV_HOME);
-    if (!home)
-        ash_env_set_var_home();
 
     ash_env_set_vars();
     ash_env_set_util();
-    ash_env_dir();
 }
 
 static void init(void)
@@ -385,22 +608,3 @@ const struct ash_unit_module ash_module_env = {
     .init = init,
     .destroy = NULL
 };
-
-/* the default ash greeter */
-static const char acorn[] =
-"        $$$      \n"
-"         $$      \n"
-"       $$$$$$    \n"
-"     $$$$$$$$$$  \n"
-"    $$$oooooo$$$ \n"
-"    $$oooooooo$$ \n"
-"     $oooooooo$  \n"
-"      oooooooo   \n"
-"        oooo     \n"
-"\n";
-
-static void ash_default_greeter(void)
-{
-    ash_str_set(greeter, acorn);
-    ash_var_set(ASH_ENV_GREETER, greeter);
-}
@@ -14,6 +14,9 @@
    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+/* memfd_create, pipe2 */
+#define _GNU_SOURCE
+
 #include <assert.h>
 #include <errno.h>
 #include <signal.h>
@@ -29,9 +32,12 @@
 #include "ash/int.h"
 #include "ash/io.h"
 #include "ash/macro.h"
+#include "ash/mem.h"
 #include "ash/obj.h"
+#include "ash/ops.h"
 #include "ash/signal.h"
 #include "ash/str.h"
+#include "ash/trace.h"
 #include "ash/type.h"
 #include "ash/unit.h"
 #include "ash/var.h"
@@ -39,9 +45,14 @@
 #include "ash/util/vec.h"
 
 #ifdef ASH_PLATFORM_POSIX
+    #include <fcntl.h>
+    #include <spawn.h>
+    #include <sys/mman.h>
     #include <sys/types.h>
     #include <sys/wait.h>
     #include <unistd.h>
+
+    extern char **environ;
 #endif
 
 #define ASH_FD_STDIN  0
@@ -51,12 +62,28 @@
 #define ASH_EXIT_FAILURE EXIT_FAILURE
 #define ASH_EXIT_DEFAULT ASH_EXIT_SUCCESS
 
+/* offset added to the signal number of a killed subshell */
+#define ASH_STATUS_SIGNAL 128
+/* status of a command which could not be executed */
+#define ASH_STATUS_NOEXEC 127
+
+/* mode of files created by a redirection */
+#define ASH_REDIRECT_MODE 0666
+
 struct proc {
     int input;
     int output;
     const char *name;
     int argc;
     char *const *argv;
+    struct vec *io;
+};
+
+/* a descriptor installed as `fd` while a command runs */
+struct redirect {
+    int fd;
+    int source;
+    bool owned;
 };
 
 static void
@@ -68,6 +95,7 @@ proc_init(struct proc *proc, const char *name, struct vec *args,
     proc->name = name;
     proc->argc = vec_len(args);
     proc->argv = (char *const *) vec_get_ref(args);
+    proc->io = NULL;
 }
 
 static void
@@ -119,32 +147,153 @@ static void ash_print_err_command(const char *command, const char *msg)
     ash_print(PNAME ": '%s': %s \n", command, msg);
 }
 
-static inline void
-ash_exec_child(struct proc *proc)
+static int ash_exec_write(int fd, const char *buf, size_t len)
+{
+    ssize_t n;
+
+    while (len > 0) {
+        if ((n = write(fd, buf, len)) == -1) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* a descriptor reading the text of a here-string from memory */
+static int ash_exec_herestring(const char *text)
 {
-    if (proc->input != ASH_FD_STDIN) {
-        dup2(proc->input, ASH_FD_STDIN);
-        close(proc->input);
+    int fd;
+
+#ifdef MFD_CLOEXEC
+    fd = memfd_create(PNAME, MFD_CLOEXEC);
+#else
+    FILE *fp;
+    fd = -1;
+    if ((fp = tmpfile())) {
+        fd = fcntl(fileno(fp), F_DUPFD_CLOEXEC, 0);
+        fclose(fp);
     }
+#endif
 
-    if (proc->output != ASH_FD_STDOUT) {
-        dup2(proc->output, ASH_FD_STDOUT);
-        close(proc->output);
+    if (fd == -1)
+        return -1;
+
+    if (ash_exec_write(fd, text, strlen(text)) ||
+        ash_exec_write(fd, "\n", 1) ||
+        lseek(fd, 0, SEEK_SET) == -1) {
+        close(fd);
+        return -1;
     }
 
-    if (execvp(proc->name, proc->argv) == -1) {
-        const char *msg = (errno == ENOENT) ?
-            "command not found!": strerror(errno);
-        ash_print_err_command(proc->name, msg);
+    return fd;
+}
+
+static int
+ash_exec_redirect_open(struct ash_exec_redirection *io, struct redirect *r)
+{
+    int flags = O_CLOEXEC;
+
+    r->fd = io->fd;
+    r->owned = true;
+
+    switch (io->type) {
+        case ASH_REDIRECTION:
+            flags |= O_WRONLY | O_CREAT | O_TRUNC;
+            break;
+
+        case ASH_APPEND:
+            flags |= O_WRONLY | O_CREAT | O_APPEND;
+            break;
+
+        case ASH_INDIRECTION:
+            flags |= O_RDONLY;
+            break;
+
+        case ASH_DUPLICATION:
+            if (!ash_stoi_check(io->target)) {
+                ash_print_err_command(io->target, "bad file descriptor");
+                return -1;
+            }
+            r->source = atoi(io->target);
+            r->owned = false;
+            return 0;
+
+        case ASH_HERESTRING:
+            if ((r->source = ash_exec_herestring(io->target)) == -1) {
+                ash_print_errno("here-string");
+                return -1;
+            }
+            return 0;
+
+        default:
+            return -1;
+    }
+
+    if ((r->source = open(io->target, flags, ASH_REDIRECT_MODE)) == -1) {
+        ash_print_err_command(io->target, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static void ash_exec_redirect_close(struct redirect *r, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        if (r[i].owned)
+            close(r[i].source);
+    }
+    ash_free(r);
+}
+
+/*
+collect the descriptors of a process in the order they are installed,
+the pipeline descriptors come first followed by any redirections
+*/
+static int
+ash_exec_redirect(struct proc *proc, struct redirect **redirect, size_t *n)
+{
+    struct redirect *r;
+    size_t len = 0, count;
+
+    count = (proc->io) ? vec_len(proc->io): 0;
+    *redirect = NULL;
+    *n = 0;
+
+    if (count == 0 &&
+        proc->input == ASH_FD_STDIN &&
+        proc->output == ASH_FD_STDOUT)
+        return 0;
+
+    r = ash_alloc((count + 2) * sizeof *r);
+
+    if (proc->input != ASH_FD_STDIN)
+        r[len++] = (struct redirect) { ASH_FD_STDIN, proc->input, true };
+
+    if (proc->output != ASH_FD_STDOUT)
+        r[len++] = (struct redirect) { ASH_FD_STDOUT, proc->output, true };
+
+    for (size_t i = 0; i < count; ++i) {
+        if (ash_exec_redirect_open(vec_get(proc->io, i), &r[len])) {
+            ash_exec_redirect_close(r, len);
+            return -1;
+        }
+        len++;
     }
-    _exit(0);
+
+    *redirect = r;
+    *n = len;
+    return 0;
 }
 
 static inline int
-ash_exec_wait(struct proc *proc)
+ash_exec_wait(struct proc *proc, pid_t pid)
 {
     int status;
-    wait(&status);
+    waitpid(pid, &status, 0);
     if (WIFSIGNALED(status))
         ash_print("%s %s\n", ash_signal_get(WTERMSIG(status)), proc->name);
 
@@ -154,22 +303,71 @@ ash_exec_wait(struct proc *proc)
     return status;
 }
 
-static int
-ash_exec_process(struct proc *proc)
+/* start a process without waiting, returns its pid or -1 on failure */
+static pid_t
+ash_exec_spawn(struct proc *proc)
 {
     pid_t pid;
-    int status = ASH_EXIT_DEFAULT;
+    int err;
+    size_t n;
+    const char *path;
+    struct redirect *r;
+    posix_spawn_file_actions_t actions;
+
+    if (ash_exec_redirect(proc, &r, &n)) {
+        ash_exec_env_result(&env, NULL);
+        ash_exec_env_exit(&env, ASH_EXIT_FAILURE);
+        return -1;
+    }
 
-    pid = fork();
-    if (pid == -1) {
-        ash_print_err("unable to fork process!");
+    posix_spawn_file_actions_init(&actions);
+    for (size_t i = 0; i < n; ++i)
+        posix_spawn_file_actions_adddup2(&actions, r[i].source, r[i].fd);
+
+    ash_flush();
+    if ((path = ash_command_path(proc->name))) {
+        err = posix_spawn(&pid, path, &actions, NULL, proc->argv, environ);
+        /* the cached location is stale, search PATH again */
+        if (err == ENOENT) {
+            ash_command_path_forget(proc->name);
+            path = NULL;
+        }
+    }
+
+    if (!path)
+        err = posix_spawnp(&pid, proc->name, &actions, NULL,
+                           proc->argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (r)
+        ash_exec_redirect_close(r, n);
+
+    if (err) {
+        const char *msg = (err == ENOENT) ?
+            "command not found!": strerror(err);
+        ash_print_err_command(proc->name, msg);
+        ash_exec_env_result(&env, NULL);
+        ash_exec_env_exit(&env, ASH_STATUS_NOEXEC);
         return -1;
-    } else if (pid == 0) {
-        ash_exec_child(proc);
-    } else {
-        status = ash_exec_wait(proc);
     }
 
+    return pid;
+}
+
+static int
+ash_exec_process(struct proc *proc)
+{
+    int status;
+    pid_t pid;
+    uint64_t start;
+
+    start = ash_trace_now();
+    if ((pid = ash_exec_spawn(proc)) == -1)
+        status = ash_int_get(env.exit);
+    else
+        status = ash_exec_wait(proc, pid);
+
+    ash_trace(ASH_TRACE_COMMAND, proc->name, start, status,
+              (pid == -1) ? 0: pid);
     return status;
 }
 
@@ -182,116 +380,289 @@ ash_exec_command_status(int status, struct ash_command_env *cenv)
     ash_exec_env_exit(&env, status);
 }
 
-enum ash_exec_io {
-    ASH_STDIO = 0,
-    ASH_IN    = 1 << 1,
-    ASH_OUT   = 1 << 2
-};
+/* the original descriptors replaced while a builtin runs */
+#define ASH_FD_SAVE_MIN 10
 
 static int
 ash_exec_builtin(struct proc *proc, enum ash_command_name command,
                  struct ash_runtime_env *renv)
 {
     int status;
-    int in, out;
-    enum ash_exec_io io = ASH_STDIO;
-    struct ash_command_env env;
-
-    if (proc->input != ASH_FD_STDIN) {
-        in = dup(ASH_FD_STDIN);
-        io |= ASH_IN;
-        dup2(proc->input, ASH_FD_STDIN);
-        close(proc->input);
+    size_t n;
+    uint64_t start;
+    struct redirect *r;
+    struct ash_command_env cenv;
+
+    start = ash_trace_now();
+    if (ash_exec_redirect(proc, &r, &n)) {
+        ash_exec_env_exit(&env, ASH_EXIT_FAILURE);
+        ash_trace(ASH_TRACE_BUILTIN, proc->name, start, ASH_EXIT_FAILURE, 0);
+        return ASH_EXIT_FAILURE;
     }
 
-    if (proc->output != ASH_FD_STDOUT) {
-        out = dup(ASH_FD_STDOUT);
-        io |= ASH_OUT;
-        dup2(proc->output, ASH_FD_STDOUT);
-        close(proc->output);
+    int saved[n + 1];
+    if (n > 0)
+        ash_flush();
+
+    for (size_t i = 0; i < n; ++i) {
+        saved[i] = fcntl(r[i].fd, F_DUPFD_CLOEXEC, ASH_FD_SAVE_MIN);
+        dup2(r[i].source, r[i].fd);
     }
 
-    ash_command_env_init(&env, renv);
+    ash_command_env_init(&cenv, renv);
     status = ash_command_exec(
-        command, proc->argc, (const char * const *)proc->argv, &env
+        command, proc->argc, (const char * const *)proc->argv, &cenv
     );
-    ash_exec_command_status(status, &env);
+    ash_exec_command_status(status, &cenv);
+
+    if (n > 0) {
+        ash_flush();
+
+        /* restore in reverse so each descriptor regains its original */
+        for (size_t i = n; i-- > 0;) {
+            if (saved[i] == -1) {
+                close(r[i].fd);
+            } else {
+                dup2(saved[i], r[i].fd);
+                close(saved[i]);
+            }
+        }
+        ash_exec_redirect_close(r, n);
+    }
+
+    ash_trace(ASH_TRACE_BUILTIN, proc->name, start, status, 0);
+    return status;
+}
 
-    if (io & ASH_IN)
-        dup2(in, ASH_FD_STDIN);
+/*
+run a builtin within a forked child so that it executes
+concurrently with the other stages of a pipeline
+*/
+static pid_t
+ash_exec_builtin_fork(struct proc *proc, enum ash_command_name command,
+                      struct ash_runtime_env *renv)
+{
+    pid_t pid;
+    int status;
+    size_t n;
+    struct redirect *r;
+    struct ash_command_env cenv;
 
-    if (io & ASH_OUT)
-        dup2(out, ASH_FD_STDOUT);
+    if (ash_exec_redirect(proc, &r, &n))
+        return -1;
 
-    return status;
+    ash_flush();
+    if ((pid = fork()) == -1) {
+        ash_print_err("unable to fork process!");
+    } else if (pid == 0) {
+        for (size_t i = 0; i < n; ++i)
+            dup2(r[i].source, r[i].fd);
+
+        ash_command_env_init(&cenv, renv);
+        status = ash_command_exec(
+            command, proc->argc, (const char * const *)proc->argv, &cenv
+        );
+        ash_flush();
+        ash_trace_flush();
+        _exit(status);
+    }
+
+    if (r)
+        ash_exec_redirect_close(r, n);
+    return pid;
+}
+
+/*
+resolve the command named by argv within a single table probe,
+returning the name replaced by an alias if any
+*/
+static const char *
+ash_exec_resolve(struct vec *argv, enum ash_command_name *command)
+{
+    const char *name;
+
+    name = vec_get(argv, 0);
+    *command = ash_command_resolve(&name);
+    if (name == vec_get(argv, 0))
+        return NULL;
+
+    return vec_set(argv, 0, (char *)name);
 }
 
+/*
+every stage of a pipeline is started before any is waited upon,
+so that no stage has to hold the entire output of the previous one.
+the final stage runs in the shell when it is a builtin so that its
+effects (e.g. `read`) remain visible afterwards
+*/
 int ash_exec_pipeline(struct vec *seq, struct ash_runtime_env *renv)
 {
     int fd[2];
     int input = ASH_FD_STDIN;
+    int status, stage;
     size_t count, index;
-    const char *name = NULL;
+    uint64_t start;
+    const char *name, *alias[vec_len(seq)];
+    pid_t pid[vec_len(seq)];
     struct proc proc;
     struct ash_exec_seq *eseq;
-    enum ash_command_name command;
+    enum ash_command_name command[vec_len(seq)];
 
     count = vec_len(seq);
     index = (count - 1);
+    start = ash_trace_now();
 
-    if (count > 1) {
-        for (int i = 0; i < index; ++i) {
-            if (pipe(fd) == -1) {
-                ash_print_err("unable to open pipe!");
-                return -1;
-            }
+    for (size_t i = 0; i < count; ++i) {
+        eseq = vec_get(seq, i);
+        alias[i] = ash_exec_resolve(eseq->argv, &command[i]);
+        if (!ash_command_valid(command[i]))
+            vec_push(eseq->argv, NULL);
+    }
+
+    for (size_t i = 0; i < index; ++i) {
+        if (pipe2(fd, O_CLOEXEC) == -1) {
+            ash_print_err("unable to open pipe!");
+            if (input != ASH_FD_STDIN)
+                close(input);
+            index = i;
+            break;
+        }
 
-            eseq = vec_get(seq, i);
-            name = vec_get(eseq->argv, 0);
-            proc_init(&proc, name, eseq->argv, input, fd[1]);
-            command = ash_command_find(name);
+        eseq = vec_get(seq, i);
+        name = vec_get(eseq->argv, 0);
+        proc_init(&proc, name, eseq->argv, input, fd[1]);
+        proc.io = eseq->io;
 
-            if (ash_command_valid(command))
-                ash_exec_builtin(&proc, command, renv);
-            else
-                ash_exec_process(&proc);
+        /* descriptors passed to a stage are closed once it starts */
+        if (ash_command_valid(command[i]))
+            pid[i] = ash_exec_builtin_fork(&proc, command[i], renv);
+        else
+            pid[i] = ash_exec_spawn(&proc);
 
-            close(fd[1]);
-            input = fd[0];
-        }
+        input = fd[0];
     }
 
     eseq = vec_get(seq, index);
     name = vec_get(eseq->argv, 0);
     proc_init(&proc, name, eseq->argv, input, ASH_FD_STDOUT);
-    command = ash_command_find(name);
+    proc.io = eseq->io;
+
+    if (index != count - 1) {
+        status = -1;
+    } else if (ash_command_valid(command[index])) {
+        status = ash_exec_builtin(&proc, command[index], renv);
+    } else if ((pid[index] = ash_exec_spawn(&proc)) == -1) {
+        status = ash_int_get(env.exit);
+    } else {
+        status = ash_exec_wait(&proc, pid[index]);
+        ash_trace(ASH_TRACE_COMMAND, name, start, status, pid[index]);
+    }
+
+    /*
+    earlier stages are reaped silently, they may end with SIGPIPE.
+    a traced stage lasts from the start of the pipeline until reaped
+    */
+    for (size_t i = 0; i < index; ++i) {
+        if (pid[i] == -1 || waitpid(pid[i], &stage, 0) == -1)
+            continue;
+        eseq = vec_get(seq, i);
+        ash_trace(ash_command_valid(command[i]) ?
+                  ASH_TRACE_BUILTIN: ASH_TRACE_COMMAND,
+                  vec_get(eseq->argv, 0), start,
+                  WIFSIGNALED(stage) ?
+                  ASH_STATUS_SIGNAL + WTERMSIG(stage): WEXITSTATUS(stage),
+                  pid[i]);
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        eseq = vec_get(seq, i);
+        if (alias[i])
+            vec_set(eseq->argv, 0, (char *)alias[i]);
+    }
+
+    return status;
+}
 
-    if (ash_command_valid(command))
-        return ash_exec_builtin(&proc, command, renv);
+int ash_exec_subshell(void (*main)(void *), void *data, int *pid)
+{
+    int fd[2];
+    pid_t child;
+
+    if (pipe2(fd, O_CLOEXEC) == -1) {
+        ash_print_err("unable to open pipe!");
+        return -1;
+    }
+
+    ash_flush();
+    child = fork();
+    if (child == -1) {
+        ash_print_err("unable to fork process!");
+        close(fd[0]);
+        close(fd[1]);
+        return -1;
+    } else if (child == 0) {
+        close(fd[0]);
+        dup2(fd[1], ASH_FD_STDOUT);
+        close(fd[1]);
+        main(data);
+        ash_flush();
+        ash_trace_flush();
+        _exit(ash_int_get(env.exit));
+    }
+
+    close(fd[1]);
+    *pid = child;
+    return fd[0];
+}
+
+int ash_exec_subshell_wait(int pid)
+{
+    int status;
+
+    if (waitpid(pid, &status, 0) == -1)
+        return -1;
+
+    if (WIFSIGNALED(status))
+        status = ASH_STATUS_SIGNAL + WTERMSIG(status);
     else
-        return ash_exec_process(&proc);
+        status = WEXITSTATUS(status);
+    ash_exec_env_exit(&env, status);
+    return status;
+}
+
+char *ash_exec_capture(void (*main)(void *), void *data, size_t *length)
+{
+    int fd, pid;
+    char *output;
+
+    if ((fd = ash_exec_subshell(main, data, &pid)) == -1)
+        return NULL;
+
+    output = ash_io_read_fd(fd, length);
+    close(fd);
+    ash_exec_subshell_wait(pid);
+    return output;
 }
 
-int ash_exec_command(struct vec *vec, struct ash_runtime_env *renv)
+int ash_exec_command(struct vec *vec, struct vec *io,
+                     struct ash_runtime_env *renv)
 {
     int status;
     struct proc proc;
     const char *name, *alias;
     enum ash_command_name command;
 
+    alias = ash_exec_resolve(vec, &command);
     name = vec_get(vec, 0);
-    if ((alias = ash_alias_get(name))) {
-        name = alias;
-        alias = vec_set(vec, 0, (char *)name);
-    }
-    command = ash_command_find(name);
 
     if (ash_command_valid(command)) {
         proc_init_default(&proc, name, vec);
+        proc.io = io;
         status = ash_exec_builtin(&proc, command, renv);
     } else {
         vec_push(vec, NULL);
         proc_init_default(&proc, name, vec);
+        proc.io = io;
         status = ash_exec_process(&proc);
     }
 
@@ -32,8 +32,12 @@
 
 #ifdef ASH_PLATFORM_POSIX
     #include <sys/stat.h>
+    #include <unistd.h>
 #endif
 
+/* initial size of the buffer used to drain a descriptor */
+#define ASH_IO_BUFSIZ 4096
+
 static inline long fsize(FILE *fp)
 {
     if (fseek(fp, 0, SEEK_END) == -1)
@@ -80,13 +84,46 @@ const char *ash_io_read(const char *name)
     return content;
 }
 
+char *ash_io_read_fd(int fd, size_t *length)
+{
+    char *buf;
+    size_t size = ASH_IO_BUFSIZ, len = 0;
+    ssize_t n;
+
+    buf = ash_alloc(size);
+
+    for (;;) {
+        if (len + 1 == size) {
+            size *= 2;
+            buf = ash_realloc(buf, size);
+        }
+
+        if ((n = read(fd, buf + len, size - len - 1)) == -1) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (n == 0)
+            break;
+        len += n;
+    }
+
+    buf[len] = '\0';
+    if (length)
+        *length = len;
+    return buf;
+}
+
+/* pending output is written before blocking on input */
 const char *ash_scan(const char *prompt)
 {
+    ash_flush();
     return ash_term_get(prompt);
 }
 
 const char *ash_scan_prompt(const char *prompt)
 {
+    ash_flush();
     return ash_term_get_raw(prompt);
 }
 
@@ -100,10 +137,12 @@ void ash_print(const char *fmt, ...)
 
 struct ash_io_setting {
     bool silent;
+    bool unbuffered;
 };
 
 static struct ash_io_setting setting = {
-    .silent = false
+    .silent = false,
+    .unbuffered = false
 };
 
 void ash_io_silent(bool value)
@@ -111,11 +150,34 @@ void ash_io_silent(bool value)
     setting.silent = value;
 }
 
+/*
+standard output is line buffered on a terminal and block buffered
+otherwise, it is flushed explicitly before anything that could
+observe it (a new process, the prompt, a blocking read or exit)
+*/
+static void ash_io_buffer(struct ash_io_setting *setting)
+{
+    int mode;
+
+    if (setting->unbuffered)
+        mode = _IONBF;
+    else
+        mode = isatty(fileno(stdout)) ? _IOLBF: _IOFBF;
+
+    ash_flush();
+    setvbuf(stdout, NULL, mode, BUFSIZ);
+}
+
+void ash_io_unbuffered(bool value)
+{
+    setting.unbuffered = value;
+    ash_io_buffer(&setting);
+}
+
 void ash_vprint(const char *fmt, va_list ap)
 {
     if (!setting.silent)
         vfprintf(stdout, fmt, ap);
-    ash_flush();
 }
 
 void ash_puts(const char *s)
@@ -125,7 +187,8 @@ void ash_puts(const char *s)
 
 void ash_putchar(char c)
 {
-    ash_print("%c", c);
+    if (!setting.silent)
+        putchar(c);
 }
 
 void ash_flush(void)
@@ -150,6 +213,7 @@ void ash_print_errno(const char *msg)
 
 static void init(void)
 {
+    ash_io_buffer(&setting);
     ash_unit_module_init(&ash_module_term);
 }
 
@@ -19,6 +19,7 @@
 #include "ash/mem.h"
 #include "ash/module.h"
 #include "ash/obj.h"
+#include "ash/ops.h"
 #include "ash/type.h"
 #include "ash/var.h"
 #include "ash/util/hash.h"
@@ -28,6 +29,7 @@
 #define VARIABLE_SIZE 37
 #define FUNCTION_SIZE 37
 #define SUBMODULE_SIZE 37
+#define LOADED_SIZE 37
 
 struct ash_module {
     const char *name;
@@ -42,7 +44,7 @@ ash_module_new(const char *name)
 {
     struct ash_module *module;
     module = ash_alloc(sizeof *module);
-    module->name = name;
+    module->name = ash_strcpy(name);
 
     struct hashmeta meta;
     hash_meta_string_init(&meta, VARIABLE_SIZE);
@@ -83,7 +85,7 @@ set(struct ash_module *module, const char *name)
         module->module = map_new(meta);
     }
 
-    map_insert(module->module, (key_t *)name, m);
+    map_insert(module->module, (key_t *)m->name, m);
     return m;
 }
 
@@ -137,7 +139,7 @@ var_set(struct map *map, const char *id, struct ash_obj *obj)
 
     var = ash_var_new(id);
     ash_var_bind(var, obj);
-    map_insert(map, (key_t *)id, var);
+    map_insert(map, (key_t *)ash_var_id(var), var);
     return var;
 }
 
@@ -153,7 +155,7 @@ var_set_override(struct map *map, const char *id,
 
     var = ash_var_new(id);
     ash_var_bind(var, obj);
-    map_insert(map, (key_t *)id, var);
+    map_insert(map, (key_t *)ash_var_id(var), var);
     return var;
 }
 
@@ -248,9 +250,57 @@ ash_module_root(void)
     return module;
 }
 
+/*
+the scripts that have been loaded, keyed by their canonical
+path, so that a script is only loaded once
+*/
+struct loaded {
+    const char *path;
+    struct ash_module_file file;
+};
+
+static struct map *loaded;
+
+bool
+ash_module_loaded(const char *path, struct ash_module_file *file)
+{
+    struct loaded *l;
+    if (!(l = map_get(loaded, (key_t *)path)))
+        return false;
+    if (file)
+        *file = l->file;
+    return true;
+}
+
+void
+ash_module_load(const char *path, struct ash_module_file *file)
+{
+    struct loaded *l;
+    if (!(l = map_get(loaded, (key_t *)path))) {
+        l = ash_alloc(sizeof *l);
+        l->path = ash_strcpy(path);
+        map_insert(loaded, (key_t *)l->path, l);
+    }
+
+    l->file = *file;
+}
+
+void
+ash_module_unload(const char *path)
+{
+    struct loaded *l;
+    if ((l = map_remove(loaded, (key_t *)path))) {
+        ash_free((char *)l->path);
+        ash_free(l);
+    }
+}
+
 static void init(void)
 {
+    struct hashmeta meta;
     module = ash_module_new(ROOT_NAME);
+    hash_meta_string_init(&meta, LOADED_SIZE);
+    loaded = map_new(meta);
 }
 
 const struct ash_unit_module ash_module_module = {
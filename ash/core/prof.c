@@ -0,0 +1,200 @@
+/* Copyright 2019 eomain
+   this program is licensed under the 2-clause BSD license
+   see COPYING for the full license info
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "ash/ash.h"
+#include "ash/io.h"
+#include "ash/mem.h"
+#include "ash/ops.h"
+#include "ash/prof.h"
+#include "ash/type.h"
+
+/* the interval of the sampling timer in microseconds */
+#define PROF_INTERVAL 1000
+#define PROF_TABLE_SIZE 256
+/* the longest stack recorded, deeper frames are cut */
+#define PROF_STACK_SIZE 4096
+
+/*
+with `--profile FILE` the ash call stack is sampled as the shell
+uses cpu time. the timer only counts ticks; the stack is read at
+the next statement, as then it is known to be consistent. at exit
+the samples are written in the collapsed format of flame graphs,
+one stack per line with the frames from the outermost, as in
+`script.ash:12;main:4;fib:3 17`
+*/
+
+struct prof_stack {
+    const char *key;
+    size_t count;
+    /* the next in the order first sampled */
+    struct prof_stack *next;
+    /* the next in the same bucket */
+    struct prof_stack *chain;
+};
+
+struct prof {
+    const char *path;
+    pid_t pid;
+    struct prof_stack *table[PROF_TABLE_SIZE];
+    struct prof_stack *stacks;
+    struct prof_stack **tail;
+};
+
+static struct prof prof = {
+    .path = NULL,
+    .stacks = NULL,
+    .tail = &prof.stacks
+};
+
+static struct ash_prof_frame root = {
+    .name = PNAME,
+    .line = 0,
+    .prev = NULL
+};
+
+struct ash_prof_frame *ash_prof_top = NULL;
+volatile sig_atomic_t ash_prof_ticks = 0;
+
+static void prof_tick(int signal)
+{
+    ash_prof_ticks++;
+}
+
+/* the name of a frame, without the separators of the format */
+static size_t prof_frame(char *s, size_t size, struct ash_prof_frame *frame)
+{
+    size_t len;
+    int n;
+
+    if (frame->line)
+        n = snprintf(s, size, "%s:%zu", frame->name, frame->line);
+    else
+        n = snprintf(s, size, "%s", frame->name);
+    len = (n < 0) ? 0: ((size_t) n < size) ? (size_t) n: size - 1;
+
+    for (size_t i = 0; i < len; ++i) {
+        if (s[i] == ';' || s[i] == ' ')
+            s[i] = '_';
+    }
+    return len;
+}
+
+/* the stack from the outermost frame, frames are counted from the top */
+static size_t prof_key(char *s, size_t size, struct ash_prof_frame *frame)
+{
+    size_t len = 0;
+
+    if (frame->prev) {
+        len = prof_key(s, size, frame->prev);
+        if (len + 1 < size)
+            s[len++] = ';';
+    }
+    if (len + 1 < size)
+        len += prof_frame(s + len, size - len, frame);
+    return len;
+}
+
+static size_t prof_hash(const char *s)
+{
+    size_t hash = 5381;
+    while (*s)
+        hash = (hash * 33) ^ (unsigned char) *s++;
+    return hash % PROF_TABLE_SIZE;
+}
+
+void ash_prof_sample(void)
+{
+    size_t ticks, hash;
+    char key[PROF_STACK_SIZE];
+    struct prof_stack *stack;
+
+    ticks = ash_prof_ticks;
+    ash_prof_ticks = 0;
+
+    key[prof_key(key, sizeof key, ash_prof_top)] = '\0';
+    hash = prof_hash(key);
+    for (stack = prof.table[hash]; stack; stack = stack->chain) {
+        if (!strcmp(stack->key, key))
+            break;
+    }
+
+    if (!stack) {
+        stack = ash_alloc(sizeof *stack);
+        stack->key = ash_strcpy(key);
+        stack->count = 0;
+        stack->next = NULL;
+        stack->chain = prof.table[hash];
+        prof.table[hash] = stack;
+        *prof.tail = stack;
+        prof.tail = &stack->next;
+    }
+    stack->count += ticks;
+}
+
+static void prof_write(void)
+{
+    FILE *file;
+    struct itimerval timer = { { 0, 0 }, { 0, 0 } };
+
+    /* commands forked from the shell share the exit */
+    if (getpid() != prof.pid)
+        return;
+
+    setitimer(ITIMER_PROF, &timer, NULL);
+    ash_prof_top = NULL;
+
+    if (!(file = fopen(prof.path, "w"))) {
+        ash_print(PNAME ": error: unable to write profile `%s`.\n",
+                  prof.path);
+        return;
+    }
+
+    for (struct prof_stack *s = prof.stacks; s; s = s->next)
+        fprintf(file, "%s %zu\n", s->key, s->count);
+    fclose(file);
+}
+
+/* sample the shell until it exits, when the profile is written */
+void ash_prof_start(const char *path)
+{
+    struct sigaction act;
+    struct itimerval timer = {
+        { 0, PROF_INTERVAL },
+        { 0, PROF_INTERVAL }
+    };
+
+    if (ash_prof_top)
+        return;
+
+    prof.path = path;
+    prof.pid = getpid();
+    atexit(prof_write);
+
+    act.sa_handler = prof_tick;
+    sigemptyset(&act.sa_mask);
+    act.sa_flags = SA_RESTART;
+    sigaction(SIGPROF, &act, NULL);
+
+    ash_prof_top = &root;
+    setitimer(ITIMER_PROF, &timer, NULL);
+}
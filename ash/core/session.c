@@ -59,19 +59,22 @@ user_init(struct user *user)
     endpwent();
 }
 
-static void
-user_var(struct user *user)
+/* the user map is only built when `USER` is first read */
+static struct ash_obj *
+user_var(void)
 {
     struct ash_obj *obj;
-    obj = ash_map_new();
+    struct user user;
 
-    ash_map_insert(obj, "uid",  ash_int_from((isize) user->uid));
-    ash_map_insert(obj, "gid",  ash_int_from((isize) user->gid));
-    ash_map_insert(obj, "euid", ash_int_from((isize) user->euid));
-    ash_map_insert(obj, "root", ash_bool_from(user->root));
-    ash_map_insert(obj, "name", ash_str_from(user->name));
+    user_init(&user);
+    obj = ash_map_new();
 
-    ash_var_set(USER, obj);
+    ash_map_insert(obj, "uid",  ash_int_from((isize) user.uid));
+    ash_map_insert(obj, "gid",  ash_int_from((isize) user.gid));
+    ash_map_insert(obj, "euid", ash_int_from((isize) user.euid));
+    ash_map_insert(obj, "root", ash_bool_from(user.root));
+    ash_map_insert(obj, "name", ash_str_from(user.name));
+    return obj;
 }
 
 static inline bool
@@ -120,7 +123,6 @@ struct ash_session {
     bool script;
     int status;
     apid pid;
-    struct user user;
     struct ash_session_profile profile;
 };
 
@@ -134,8 +136,7 @@ void ash_session_init(struct ash_session *session,
     session->status = 0;
     session->script = false;
     session->pid = getpid();
-    user_init(&session->user);
-    user_var(&session->user);
+    ash_var_set_lazy(USER, user_var);
     ash_session_profile_init(&session->profile);
 }
 
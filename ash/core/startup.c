@@ -0,0 +1,77 @@
+/* Copyright 2019 eomain
+   this program is licensed under the 2-clause BSD license
+   see COPYING for the full license info
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <time.h>
+
+#include "ash/ash.h"
+#include "ash/startup.h"
+#include "ash/type.h"
+
+/*
+with `--startup-trace` the time spent in each phase of startup
+is written to stderr as it ends, followed by the total when the
+shell begins to run its input
+*/
+struct startup {
+    bool trace;
+    struct timespec begin;
+    struct timespec last;
+};
+
+static struct startup startup = {
+    .trace = false
+};
+
+static double elapsed(const struct timespec *from,
+                      const struct timespec *to)
+{
+    return (to->tv_sec - from->tv_sec) * 1e3 +
+           (to->tv_nsec - from->tv_nsec) / 1e6;
+}
+
+void ash_startup_trace(void)
+{
+    startup.trace = true;
+    clock_gettime(CLOCK_MONOTONIC, &startup.begin);
+    startup.last = startup.begin;
+}
+
+void ash_startup_phase(const char *name)
+{
+    struct timespec now;
+
+    if (!startup.trace)
+        return;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    fprintf(stderr, PNAME ": startup: %-10s %9.3f ms\n",
+            name, elapsed(&startup.last, &now));
+    startup.last = now;
+}
+
+void ash_startup_done(void)
+{
+    struct timespec now;
+
+    if (!startup.trace)
+        return;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    fprintf(stderr, PNAME ": startup: %-10s %9.3f ms\n",
+            "total", elapsed(&startup.begin, &now));
+    startup.trace = false;
+}
@@ -0,0 +1,197 @@
+/* Copyright 2019 eomain
+   this program is licensed under the 2-clause BSD license
+   see COPYING for the full license info
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ash/ash.h"
+#include "ash/trace.h"
+#include "ash/type.h"
+
+/* the records held before they are written, a power of two */
+#define TRACE_RING_SIZE 512
+/* the records written at once */
+#define TRACE_BATCH 256
+/* the longest name recorded, longer ones are cut */
+#define TRACE_NAME_SIZE 48
+#define TRACE_LINE_SIZE (TRACE_NAME_SIZE + 80)
+/* the lowest descriptor the trace is written through */
+#define TRACE_FD_MIN 10
+
+/*
+with `--xtrace FD` each command, builtin and function call is
+written to FD as it ends, one line each:
+
+    <start> <duration> <pid> <status> <kind> <name>
+
+the start is the monotonic clock and the duration is in
+microseconds, the kind is `c` for a command, `b` for a builtin
+and `f` for a function, and a status of `-` is a call without
+one. records are kept in a ring and written a batch at a time,
+so that tracing costs a clock read and a copy per record. only
+the main thread of the shell records, so the ring has a single
+producer and needs no lock; a forked child drops the records of
+its parent, which remain for the parent to write
+*/
+
+struct trace_record {
+    uint64_t start;
+    uint64_t end;
+    pid_t pid;
+    int status;
+    char kind;
+    char name[TRACE_NAME_SIZE];
+};
+
+struct trace {
+    int fd;
+    pid_t pid;
+    size_t head;
+    size_t tail;
+    struct trace_record ring[TRACE_RING_SIZE];
+    char buf[TRACE_BATCH * TRACE_LINE_SIZE];
+};
+
+static struct trace trace = {
+    .fd = -1
+};
+
+bool ash_trace_enabled = false;
+
+uint64_t ash_trace_clock(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void trace_write(const char *buf, size_t len)
+{
+    ssize_t n;
+
+    while (len > 0) {
+        if ((n = write(trace.fd, buf, len)) == -1) {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+        buf += n;
+        len -= n;
+    }
+}
+
+static size_t trace_format(char *s, struct trace_record *r)
+{
+    int n;
+    char status[16];
+
+    if (r->status == ASH_TRACE_NO_STATUS)
+        strcpy(status, "-");
+    else
+        snprintf(status, sizeof status, "%d", r->status);
+
+    n = snprintf(s, TRACE_LINE_SIZE, "%llu.%06llu %llu %ld %s %c %s\n",
+                 (unsigned long long) (r->start / 1000000),
+                 (unsigned long long) (r->start % 1000000),
+                 (unsigned long long) (r->end - r->start),
+                 (long) r->pid, status, r->kind, r->name);
+    return (n < TRACE_LINE_SIZE) ? (size_t) n: TRACE_LINE_SIZE - 1;
+}
+
+void ash_trace_flush(void)
+{
+    size_t len;
+
+    while (trace.tail != trace.head) {
+        len = 0;
+        for (size_t i = 0; i < TRACE_BATCH && trace.tail != trace.head; ++i) {
+            len += trace_format(trace.buf + len,
+                &trace.ring[trace.tail & (TRACE_RING_SIZE - 1)]);
+            trace.tail++;
+        }
+        trace_write(trace.buf, len);
+    }
+}
+
+void ash_trace_record(enum ash_trace_kind kind, const char *name,
+                      uint64_t start, int status, pid_t pid)
+{
+    struct trace_record *r;
+
+    r = &trace.ring[trace.head & (TRACE_RING_SIZE - 1)];
+    r->start = start;
+    r->end = ash_trace_clock();
+    r->pid = pid ? pid: trace.pid;
+    r->status = status;
+    r->kind = kind;
+    strncpy(r->name, name ? name: "", TRACE_NAME_SIZE - 1);
+    r->name[TRACE_NAME_SIZE - 1] = '\0';
+
+    if (++trace.head - trace.tail >= TRACE_BATCH)
+        ash_trace_flush();
+}
+
+static void trace_fork_child(void)
+{
+    trace.pid = getpid();
+    trace.tail = trace.head;
+}
+
+/*
+trace to a descriptor given by number, or else to a file given
+by name; returns -1 if neither can be written. the trace goes
+through a copy of the descriptor kept from commands, the one
+given is left as it is for the commands to use
+*/
+int ash_trace_start(const char *target)
+{
+    int fd, target_fd;
+    char *end;
+    long n;
+
+    if (ash_trace_enabled)
+        return 0;
+
+    n = strtol(target, &end, 10);
+    if (*target && !*end && n >= 0 && n <= INT_MAX) {
+        fd = fcntl((int) n, F_DUPFD_CLOEXEC, TRACE_FD_MIN);
+    } else {
+        target_fd = open(target, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                         0666);
+        if (target_fd == -1)
+            return -1;
+        fd = fcntl(target_fd, F_DUPFD_CLOEXEC, TRACE_FD_MIN);
+        close(target_fd);
+    }
+
+    if (fd == -1)
+        return -1;
+
+    trace.fd = fd;
+    trace.pid = getpid();
+    pthread_atfork(NULL, NULL, trace_fork_child);
+    atexit(ash_trace_flush);
+    ash_trace_enabled = true;
+    return 0;
+}
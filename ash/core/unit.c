@@ -17,32 +17,41 @@
 #include <stddef.h>
 
 #include "ash/alias.h"
+#include "ash/command.h"
 #include "ash/env.h"
 #include "ash/io.h"
 #include "ash/module.h"
 #include "ash/signal.h"
+#include "ash/startup.h"
 #include "ash/unit.h"
 #include "ash/core/exec.h"
 #include "ash/ffi/ffi.h"
 
-static const struct ash_unit_module * const unit[] = {
-    &ash_module_module,
-    &ash_module_env,
-    &ash_module_io,
-    &ash_module_signal,
-    &ash_module_alias,
-    &ash_module_exec,
-    &ash_module_ffi,
+/* the name of each unit is shown by the startup trace */
+static const struct {
+    const char *name;
+    const struct ash_unit_module *module;
+} unit[] = {
+    { "module",  &ash_module_module  },
+    { "env",     &ash_module_env     },
+    { "io",      &ash_module_io      },
+    { "signal",  &ash_module_signal  },
+    { "command", &ash_module_command },
+    { "alias",   &ash_module_alias   },
+    { "exec",    &ash_module_exec    },
+    { "ffi",     &ash_module_ffi     },
 };
 
 void ash_unit_init(void)
 {
-    for (size_t i = 0; i < array_length(unit); i++)
-        ash_unit_module_init(unit[i]);
+    for (size_t i = 0; i < array_length(unit); i++) {
+        ash_unit_module_init(unit[i].module);
+        ash_startup_phase(unit[i].name);
+    }
 }
 
 void ash_unit_destroy(void)
 {
     for (size_t i = 0; i < array_length(unit); i++)
-        ash_unit_module_destory(unit[i]);
+        ash_unit_module_destory(unit[i].module);
 }
@@ -52,14 +52,29 @@ struct ash_var {
     struct ash_obj *obj;
     const char *id;
     bool mutable;
+    /* computes the value on first access, if it has none yet */
+    ash_var_lazy lazy;
 };
 
+/* the id is copied, it may be a string of a transient ast */
 static inline void
 ash_var_init(struct ash_var *var, const char *id)
 {
     var->obj = NULL;
-    var->id = id;
+    var->id = ash_strcpy(id);
     var->mutable = var_is_mutable(id);
+    var->lazy = NULL;
+}
+
+static void ash_var_resolve(struct ash_var *var)
+{
+    ash_var_lazy lazy;
+    struct ash_obj *obj;
+
+    lazy = var->lazy;
+    var->lazy = NULL;
+    if ((obj = lazy()))
+        ash_var_bind_override(var, obj);
 }
 
 struct ash_var *
@@ -76,6 +91,7 @@ ash_var_destroy(struct ash_var *var)
 {
     assert(var != NULL);
     ash_var_unbind(var);
+    ash_free((char *)var->id);
     ash_free(var);
 }
 
@@ -86,6 +102,8 @@ ash_var_obj(struct ash_var *var)
         return NULL;
 
     struct ash_obj *obj;
+    if (var->lazy)
+        ash_var_resolve(var);
     if ((obj = var->obj))
         ash_obj_inc_rc(obj);
     return obj;
@@ -105,6 +123,10 @@ bool ash_var_mutable(struct ash_var *var)
 void ash_var_bind(struct ash_var *var,
                   struct ash_obj *obj)
 {
+    /* a pending value is as good as a bound one */
+    if (var->lazy && !var->mutable)
+        return;
+    var->lazy = NULL;
     if (var->obj) {
         if (!var->mutable)
             return;
@@ -123,6 +145,7 @@ void ash_var_bind(struct ash_var *var,
 void ash_var_bind_override(struct ash_var *var,
                            struct ash_obj *obj)
 {
+    var->lazy = NULL;
     if (var->obj)
         ash_var_unbind(var);
     var->obj = obj;
@@ -137,6 +160,7 @@ void ash_var_bind_override(struct ash_var *var,
 
 void ash_var_unbind(struct ash_var *var)
 {
+    var->lazy = NULL;
     if (var->obj)
         ash_obj_dec_rc(var->obj);
     var->obj = NULL;
@@ -154,6 +178,20 @@ ash_var_set_override(const char *id, struct ash_obj *obj)
     return ash_module_var_set_override(ash_module_root(), id, obj);
 }
 
+/*
+bind a global to a value computed only when it is first read,
+for values that are costly to find and seldom used
+*/
+struct ash_var *
+ash_var_set_lazy(const char *id, ash_var_lazy lazy)
+{
+    struct ash_var *var;
+    var = ash_var_set(id, NULL);
+    if (!var->obj)
+        var->lazy = lazy;
+    return var;
+}
+
 struct ash_var *ash_var_get(const char *id)
 {
     return ash_module_var_get(ash_module_root(), id);
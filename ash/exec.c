@@ -59,6 +59,7 @@ int ash_exec(int argc, const char * const *argv)
     else if (argc > 1) {
         const char *prog = argv[1];
 
+        ash_flush();
         if (argc == 2) {
             char * const args[] = { (char *const) prog, NULL };
             if (execvp(prog, args))
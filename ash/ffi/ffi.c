@@ -14,9 +14,13 @@
    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#define _GNU_SOURCE
+
 #include <assert.h>
+#include <ctype.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "ash/bool.h"
 #include "ash/env.h"
@@ -25,16 +29,21 @@
 #include "ash/int.h"
 #include "ash/iter.h"
 #include "ash/macro.h"
+#include "ash/mem.h"
 #include "ash/obj.h"
 #include "ash/script.h"
 #include "ash/str.h"
 #include "ash/tuple.h"
 #include "ash/type.h"
 #include "ash/type/array.h"
+#include "ash/type/bytes.h"
+#include "ash/type/lines.h"
 #include "ash/unit.h"
 #include "ash/var.h"
+#include "ash/util/vec.h"
 
 #ifdef ASH_PLATFORM_POSIX
+	#include <fcntl.h>
 	#include <unistd.h>
 #endif
 
@@ -70,6 +79,166 @@ ffi_args_get(struct ash_obj *args, size_t pos)
 	return ash_tuple_get(args, pos);
 }
 
+/* the string argument at `pos` and its length, or NULL */
+static inline const char *
+ffi_args_str(struct ash_obj *args, size_t pos, size_t *len)
+{
+	struct ash_obj *obj;
+	const char *s;
+
+	if (ffi_args_len(args) <= pos || !(obj = ffi_args_get(args, pos)))
+		return NULL;
+	if ((s = ash_str_get(obj)))
+		*len = ash_str_len(obj);
+	return s;
+}
+
+/* the contents of a bytes or string argument at `pos`, or NULL */
+static inline const char *
+ffi_args_data(struct ash_obj *args, size_t pos, size_t *len)
+{
+	struct ash_obj *obj;
+	const char *s;
+
+	if (ffi_args_len(args) <= pos || !(obj = ffi_args_get(args, pos)))
+		return NULL;
+	if ((s = ash_bytes_get(obj))) {
+		*len = ash_bytes_len(obj);
+		return s;
+	}
+	return ffi_args_str(args, pos, len);
+}
+
+#ifdef ASH_PLATFORM_POSIX
+/* a descriptor given as an integer, or a path opened with `flags` */
+static int
+ffi_args_fd(struct ash_obj *args, size_t pos, int flags, bool *opened)
+{
+	struct ash_obj *obj;
+	const char *path;
+
+	*opened = false;
+	if (ffi_args_len(args) <= pos || !(obj = ffi_args_get(args, pos)))
+		return -1;
+	if (ash_base_derived(ash_int_base(), obj))
+		return ash_int_get(obj);
+	if (!(path = ash_str_get(obj)))
+		return -1;
+	*opened = true;
+	return open(path, flags | O_CLOEXEC, 0666);
+}
+#endif
+
+static inline bool ffi_is_space(char c)
+{
+	return (c == ' ' || c == '\t' || c == '\n' ||
+	        c == '\r' || c == '\v' || c == '\f');
+}
+
+/* parse a decimal integer, allowing surrounding whitespace; fails on overflow */
+static bool ffi_parse_int(const char *s, size_t len, isize *value)
+{
+	const char *end = s + len;
+	bool negative = false, digits = false;
+	isize n = 0, digit;
+
+	while (s < end && ffi_is_space(*s))
+		++s;
+	if (s < end && (*s == '-' || *s == '+'))
+		negative = (*s++ == '-');
+	for (; s < end && isdigit((unsigned char) *s); ++s) {
+		digit = *s - '0';
+		if (n > (ISIZE_MAX - digit) / 10)
+			return false;
+		n = (n * 10) + digit;
+		digits = true;
+	}
+	while (s < end && ffi_is_space(*s))
+		++s;
+
+	if (!digits || s != end)
+		return false;
+	*value = (negative) ? -n: n;
+	return true;
+}
+
+/* an integer argument, which may also be given as a string */
+static inline bool
+ffi_args_int(struct ash_obj *args, size_t pos, isize *value)
+{
+	struct ash_obj *obj;
+	const char *s;
+
+	if (ffi_args_len(args) <= pos || !(obj = ffi_args_get(args, pos)))
+		return false;
+	if (ash_base_derived(ash_int_base(), obj)) {
+		*value = ash_int_get(obj);
+		return true;
+	}
+	if ((s = ash_str_get(obj)))
+		return ffi_parse_int(s, ash_str_len(obj), value);
+	return false;
+}
+
+/* a new string holding a copy of `len` bytes */
+static struct ash_obj *ffi_str_from(const char *s, size_t len)
+{
+	char *copy;
+	copy = ash_alloc(len + 1);
+	memcpy(copy, s, len);
+	copy[len] = '\0';
+	return ash_str_from_len(copy, len);
+}
+
+/* the next occurrence of `sub` within [s, end) */
+static inline const char *
+ffi_find(const char *s, const char *end, const char *sub, size_t len)
+{
+	if (len == 1)
+		return memchr(s, *sub, end - s);
+	return memmem(s, end - s, sub, len);
+}
+
+/* bytes from a string, a size or an iterable of byte values */
+static struct ash_obj *bytes(struct ash_obj *args)
+{
+	size_t len = 0, size = 16;
+	const char *s;
+	struct ash_obj *obj, *item;
+	struct ash_iter iter;
+	char *value;
+
+	if (ffi_args_len(args) == 0 || !(obj = ffi_args_get(args, 0)))
+		return ash_bytes_new(ash_alloc(1), 0);
+	if (ash_bytes_get(obj))
+		return ash_bytes_slice(obj, 0, ash_bytes_len(obj));
+	if ((s = ash_str_get(obj)))
+		return ash_bytes_from(s, ash_str_len(obj));
+	if (ash_base_derived(ash_int_base(), obj)) {
+		if (ash_int_get(obj) < 0)
+			return NULL;
+		len = ash_int_get(obj);
+		return ash_bytes_new(ash_zalloc(len + 1), len);
+	}
+
+	value = ash_alloc(size + 1);
+	ash_iter_init(&iter, obj);
+	while (ash_iter_hasnext(&iter)) {
+		item = ash_iter_next(&iter);
+		if (!ash_base_derived(ash_int_base(), item)) {
+			ash_free(value);
+			return NULL;
+		}
+		if (len == size) {
+			size *= 2;
+			value = ash_realloc(value, size + 1);
+		}
+		value[len++] = ash_int_get(item);
+	}
+
+	return ash_bytes_new(value, len);
+}
+
 static struct ash_obj *env(struct ash_obj *args)
 {
 	if (ffi_args_len(args) == 0)
@@ -100,6 +269,37 @@ static struct ash_obj *exists(struct ash_obj *args)
 	return ash_bool_from(false);
 }
 
+/* the index of a substring, or -1 when it is not found */
+static struct ash_obj *find(struct ash_obj *args)
+{
+	size_t len, slen;
+	const char *s, *sub, *at;
+	isize start = 0;
+
+	if (!(s = ffi_args_str(args, 0, &len)) ||
+	    !(sub = ffi_args_str(args, 1, &slen)))
+		return NULL;
+	if (ffi_args_int(args, 2, &start) && (start < 0 || (size_t) start > len))
+		return ash_int_from(-1);
+
+	if (slen == 0)
+		return ash_int_from(start);
+	if (!(at = ffi_find(s + start, s + len, sub, slen)))
+		return ash_int_from(-1);
+	return ash_int_from(at - s);
+}
+
+static struct ash_obj *ends_with(struct ash_obj *args)
+{
+	size_t len, plen;
+	const char *s, *p;
+
+	if (!(s = ffi_args_str(args, 0, &len)) ||
+	    !(p = ffi_args_str(args, 1, &plen)))
+		return ash_bool_from(false);
+	return ash_bool_from(plen <= len && !memcmp(s + len - plen, p, plen));
+}
+
 static struct ash_obj *get(struct ash_obj *args)
 {
 	if (ffi_args_len(args) < 2)
@@ -108,9 +308,91 @@ static struct ash_obj *get(struct ash_obj *args)
 	struct ash_obj *obj, *value;
 	obj = ffi_args_get(args, 0);
 	value = ffi_args_get(args, 1);
-	if (ash_base_derived(ash_int_base(), value))
-		return ash_array_get(obj, ash_int_get(value));
-	return NULL;
+	if (!ash_base_derived(ash_int_base(), value))
+		return NULL;
+	if (ash_bytes_get(obj)) {
+		if (ash_int_get(value) < 0 ||
+		    (size_t) ash_int_get(value) >= ash_bytes_len(obj))
+			return NULL;
+		return ash_int_from(
+			(unsigned char) ash_bytes_get(obj)[ash_int_get(value)]);
+	}
+	return ash_array_get(obj, ash_int_get(value));
+}
+
+/* the contents of bytes or a string as hexadecimal digits */
+static struct ash_obj *hex(struct ash_obj *args)
+{
+	static const char digits[] = "0123456789abcdef";
+	size_t len;
+	const unsigned char *s;
+	char *value;
+
+	if (!(s = (const unsigned char *) ffi_args_data(args, 0, &len)))
+		return NULL;
+
+	value = ash_alloc((len * 2) + 1);
+	for (size_t i = 0; i < len; ++i) {
+		value[i * 2] = digits[s[i] >> 4];
+		value[(i * 2) + 1] = digits[s[i] & 0xf];
+	}
+	value[len * 2] = '\0';
+	return ash_str_from_len(value, len * 2);
+}
+
+static struct ash_obj *parse_int(struct ash_obj *args)
+{
+	isize value;
+
+	if (!ffi_args_int(args, 0, &value))
+		return NULL;
+	return ash_int_from(value);
+}
+
+/* join the items of an iterable with a separator */
+static struct ash_obj *join(struct ash_obj *args)
+{
+	size_t slen = 0, total = 0, n = 0, pos = 0;
+	const char *sep = "";
+	struct ash_obj *obj, *item;
+	struct ash_iter iter;
+	struct vec *items;
+	char *s;
+
+	if (ffi_args_len(args) == 0 || !(obj = ffi_args_get(args, 0)))
+		return NULL;
+	if (ffi_args_len(args) > 1 && !(sep = ffi_args_str(args, 1, &slen)))
+		return NULL;
+
+	items = vec_new();
+	ash_iter_init(&iter, obj);
+	while (ash_iter_hasnext(&iter)) {
+		item = ash_iter_next(&iter);
+		if (item && !ash_str_get(item))
+			item = ash_obj_str(item);
+		if (!item || !ash_str_get(item))
+			continue;
+		vec_push(items, item);
+		total += ash_str_len(item);
+	}
+
+	if ((n = vec_len(items)) > 1)
+		total += slen * (n - 1);
+
+	s = ash_alloc(total + 1);
+	for (size_t i = 0; i < n; ++i) {
+		item = vec_get(items, i);
+		if (i > 0) {
+			memcpy(s + pos, sep, slen);
+			pos += slen;
+		}
+		memcpy(s + pos, ash_str_get(item), ash_str_len(item));
+		pos += ash_str_len(item);
+	}
+	s[pos] = '\0';
+
+	vec_destroy(items);
+	return ash_str_from_len(s, pos);
 }
 
 static struct ash_obj *len(struct ash_obj *args)
@@ -124,6 +406,8 @@ static struct ash_obj *len(struct ash_obj *args)
 		struct ash_iter iter;
 
 		obj = ffi_args_get(args, 0);
+		if (ash_bytes_get(obj))
+			return ash_int_from(ash_bytes_len(obj));
 		ash_iter_init(&iter, obj);
 
 		while ((ash_iter_hasnext(&iter))) {
@@ -136,26 +420,92 @@ static struct ash_obj *len(struct ash_obj *args)
 	return ret;
 }
 
-static struct ash_obj *load(struct ash_obj *args)
+/* iterate the lines of a file without reading it all */
+static struct ash_obj *lines(struct ash_obj *args)
 {
-	if (ffi_args_len(args) > 0) {
-		const char *script;
-		struct ash_obj *obj;
-		struct ash_iter iter;
-		ash_iter_init(&iter, args);
+	if (ffi_args_len(args) == 0)
+		return NULL;
 
-		while ((ash_iter_hasnext(&iter))) {
-			obj = ash_iter_next(&iter);
-			if (!(script = ash_str_get(obj))) {
-				ash_obj_inc_rc(obj);
-				return obj;
-			}
-			if (ash_script_load(script, false) == -1)
-				return ash_str_clone_from(script);
+	const char *path;
+	if (!(path = ash_str_get(ffi_args_get(args, 0))))
+		return NULL;
+
+#ifdef ASH_PLATFORM_POSIX
+	int fd;
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) != -1)
+		return ash_lines_from(fd, -1);
+#endif
+	return NULL;
+}
+
+/*
+scripts are loaded once; a reload runs a script
+again only if it has changed since it was loaded
+*/
+static struct ash_obj *ffi_load(struct ash_obj *args, bool reload)
+{
+	size_t len;
+	isize failed;
+	const char **scripts;
+	struct ash_obj *obj, *result = NULL;
+	struct ash_iter iter;
+
+	if (!(len = ffi_args_len(args)))
+		return ash_bool_from(true);
+
+	/* the scripts up to the first that is not a string are a batch */
+	scripts = ash_alloc((sizeof *scripts) * len);
+	len = 0;
+	ash_iter_init(&iter, args);
+	while ((ash_iter_hasnext(&iter))) {
+		obj = ash_iter_next(&iter);
+		if (!(scripts[len] = ash_str_get(obj))) {
+			ash_obj_inc_rc(obj);
+			result = obj;
+			break;
 		}
+		len++;
+	}
+
+	if ((failed = ash_script_require_all(len, scripts, reload)) != -1) {
+		if (result)
+			ash_obj_dec_rc(result);
+		result = ash_str_clone_from(scripts[failed]);
 	}
 
-	return ash_bool_from(true);
+	ash_free((void *) scripts);
+	return result ? result: ash_bool_from(true);
+}
+
+static struct ash_obj *load(struct ash_obj *args)
+{
+	return ffi_load(args, false);
+}
+
+static struct ash_obj *reload(struct ash_obj *args)
+{
+	return ffi_load(args, true);
+}
+
+static struct ash_obj *str_case(struct ash_obj *args, int (*conv)(int))
+{
+	size_t len;
+	const char *s;
+	char *copy;
+
+	if (!(s = ffi_args_str(args, 0, &len)))
+		return NULL;
+
+	copy = ash_alloc(len + 1);
+	for (size_t i = 0; i < len; ++i)
+		copy[i] = conv((unsigned char) s[i]);
+	copy[len] = '\0';
+	return ash_str_from_len(copy, len);
+}
+
+static struct ash_obj *lower(struct ash_obj *args)
+{
+	return str_case(args, tolower);
 }
 
 static struct ash_obj *pop(struct ash_obj *args)
@@ -181,6 +531,175 @@ static struct ash_obj *push(struct ash_obj *args)
 	return NULL;
 }
 
+/* read bytes from a descriptor or a file, up to an optional count */
+static struct ash_obj *read_bytes(struct ash_obj *args)
+{
+#ifdef ASH_PLATFORM_POSIX
+	int fd;
+	bool opened;
+	isize count = -1;
+	struct ash_obj *obj;
+
+	if (ffi_args_len(args) > 1 && (!ffi_args_int(args, 1, &count) || count < 0))
+		return NULL;
+	if ((fd = ffi_args_fd(args, 0, O_RDONLY, &opened)) == -1)
+		return NULL;
+
+	obj = ash_bytes_read(fd, count);
+	if (opened)
+		close(fd);
+	return obj;
+#else
+	return NULL;
+#endif
+}
+
+/* replace every occurrence of a substring */
+static struct ash_obj *replace(struct ash_obj *args)
+{
+	size_t len, olen, nlen, count = 0, total, pos = 0;
+	const char *s, *old, *new, *end, *at, *p;
+	char *out;
+
+	if (!(s = ffi_args_str(args, 0, &len)) ||
+	    !(old = ffi_args_str(args, 1, &olen)) ||
+	    !(new = ffi_args_str(args, 2, &nlen)))
+		return NULL;
+
+	if (olen == 0)
+		return ffi_str_from(s, len);
+
+	end = s + len;
+	for (p = s; (at = ffi_find(p, end, old, olen)); p = at + olen)
+		count++;
+
+	total = len - (count * olen) + (count * nlen);
+	out = ash_alloc(total + 1);
+	for (p = s; (at = ffi_find(p, end, old, olen)); p = at + olen) {
+		memcpy(out + pos, p, at - p);
+		pos += at - p;
+		memcpy(out + pos, new, nlen);
+		pos += nlen;
+	}
+	memcpy(out + pos, p, end - p);
+	pos += end - p;
+	out[pos] = '\0';
+
+	return ash_str_from_len(out, pos);
+}
+
+/* a view of part of bytes sharing their storage */
+static struct ash_obj *slice(struct ash_obj *args)
+{
+	size_t len;
+	struct ash_obj *obj;
+	isize start, count;
+
+	if (ffi_args_len(args) == 0 || !(obj = ffi_args_get(args, 0)) ||
+	    !ash_bytes_get(obj) || !ffi_args_int(args, 1, &start))
+		return NULL;
+
+	len = ash_bytes_len(obj);
+	if (start < 0)
+		start = ((size_t) -start > len) ? 0: (isize) len + start;
+	if ((size_t) start > len)
+		start = len;
+	if (!ffi_args_int(args, 2, &count) || count < 0)
+		count = len - start;
+
+	return ash_bytes_slice(obj, start, count);
+}
+
+/*
+split on each occurrence of a separator or, without one,
+on runs of whitespace
+*/
+static struct ash_obj *split(struct ash_obj *args)
+{
+	size_t len, slen = 0;
+	const char *s, *sep = NULL, *end, *next;
+	struct vec *vec;
+
+	if (!(s = ffi_args_str(args, 0, &len)))
+		return NULL;
+	if (ffi_args_len(args) > 1 && !(sep = ffi_args_str(args, 1, &slen)))
+		return NULL;
+
+	vec = vec_new();
+	end = s + len;
+
+	if (!sep || slen == 0) {
+		while (s < end) {
+			while (s < end && ffi_is_space(*s))
+				++s;
+			if (s == end)
+				break;
+			for (next = s; next < end && !ffi_is_space(*next); ++next);
+			vec_push(vec, ffi_str_from(s, next - s));
+			s = next;
+		}
+	} else {
+		for (;;) {
+			if (!(next = ffi_find(s, end, sep, slen)))
+				next = end;
+			vec_push(vec, ffi_str_from(s, next - s));
+			if (next == end)
+				break;
+			s = next + slen;
+		}
+	}
+
+	return ash_array_from(vec);
+}
+
+static struct ash_obj *starts_with(struct ash_obj *args)
+{
+	size_t len, plen;
+	const char *s, *p;
+
+	if (!(s = ffi_args_str(args, 0, &len)) ||
+	    !(p = ffi_args_str(args, 1, &plen)))
+		return ash_bool_from(false);
+	return ash_bool_from(plen <= len && !memcmp(s, p, plen));
+}
+
+/* a substring from `start`, counted from the end when negative */
+static struct ash_obj *substr(struct ash_obj *args)
+{
+	size_t len;
+	const char *s;
+	isize start, count;
+
+	if (!(s = ffi_args_str(args, 0, &len)) || !ffi_args_int(args, 1, &start))
+		return NULL;
+
+	if (start < 0)
+		start = ((size_t) -start > len) ? 0: (isize) len + start;
+	if ((size_t) start > len)
+		start = len;
+	if (!ffi_args_int(args, 2, &count) || count < 0 ||
+	    (size_t) count > len - start)
+		count = len - start;
+
+	return ffi_str_from(s + start, count);
+}
+
+static struct ash_obj *trim(struct ash_obj *args)
+{
+	size_t len;
+	const char *s, *end;
+
+	if (!(s = ffi_args_str(args, 0, &len)))
+		return NULL;
+
+	end = s + len;
+	while (s < end && ffi_is_space(*s))
+		++s;
+	while (end > s && ffi_is_space(end[-1]))
+		--end;
+	return ffi_str_from(s, end - s);
+}
+
 static struct ash_obj *type(struct ash_obj *args)
 {
 	if (ffi_args_len(args) == 0)
@@ -193,37 +712,114 @@ static struct ash_obj *type(struct ash_obj *args)
 	return ash_str_clone_from(name);
 }
 
+static struct ash_obj *upper(struct ash_obj *args)
+{
+	return str_case(args, toupper);
+}
+
+/* write bytes or a string to a descriptor or a file */
+static struct ash_obj *write_bytes(struct ash_obj *args)
+{
+#ifdef ASH_PLATFORM_POSIX
+	int fd;
+	bool opened, ret;
+	size_t len;
+	const char *value;
+
+	if (!(value = ffi_args_data(args, 1, &len)))
+		return ash_bool_from(false);
+	if ((fd = ffi_args_fd(args, 0, O_WRONLY | O_CREAT | O_TRUNC,
+	                      &opened)) == -1)
+		return ash_bool_from(false);
+
+	ret = ash_bytes_write(fd, value, len);
+	if (opened && close(fd) == -1)
+		ret = false;
+	return ash_bool_from(ret);
+#else
+	return ash_bool_from(false);
+#endif
+}
+
 static struct ash_ffi_function functions[] = {
+	{
+		.name = "bytes",
+		.function = bytes,
+		.anonymous = false
+	},
+
 	{
 		.name = "env",
 		.function = env,
 		.anonymous = false
 	},
 
+	{
+		.name = "ends_with",
+		.function = ends_with,
+		.anonymous = false
+	},
+
 	{
 		.name = "exists",
 		.function = exists,
 		.anonymous = false
 	},
 
+	{
+		.name = "find",
+		.function = find,
+		.anonymous = false
+	},
+
 	{
 		.name = "get",
 		.function = get,
 		.anonymous = false
 	},
 
+	{
+		.name = "hex",
+		.function = hex,
+		.anonymous = false
+	},
+
+	{
+		.name = "int",
+		.function = parse_int,
+		.anonymous = false
+	},
+
+	{
+		.name = "join",
+		.function = join,
+		.anonymous = false
+	},
+
 	{
 		.name = "len",
 		.function = len,
 		.anonymous = false
 	},
 
+	{
+		.name = "lines",
+		.function = lines,
+		.anonymous = false
+	},
+
 	{
 		.name = "load",
 		.function = load,
 		.anonymous = false
 	},
 
+	{
+		.name = "lower",
+		.function = lower,
+		.anonymous = false
+	},
+
 	{
 		.name = "pop",
 		.function = pop,
@@ -236,10 +832,70 @@ static struct ash_ffi_function functions[] = {
 		.anonymous = false
 	},
 
+	{
+		.name = "read_bytes",
+		.function = read_bytes,
+		.anonymous = false
+	},
+
+	{
+		.name = "reload",
+		.function = reload,
+		.anonymous = false
+	},
+
+	{
+		.name = "replace",
+		.function = replace,
+		.anonymous = false
+	},
+
+	{
+		.name = "slice",
+		.function = slice,
+		.anonymous = false
+	},
+
+	{
+		.name = "split",
+		.function = split,
+		.anonymous = false
+	},
+
+	{
+		.name = "starts_with",
+		.function = starts_with,
+		.anonymous = false
+	},
+
+	{
+		.name = "substr",
+		.function = substr,
+		.anonymous = false
+	},
+
+	{
+		.name = "trim",
+		.function = trim,
+		.anonymous = false
+	},
+
 	{
 		.name = "type",
 		.function = type,
 		.anonymous = false
+	},
+
+	{
+		.name = "upper",
+		.function = upper,
+		.anonymous = false
+	},
+
+	{
+		.name = "write_bytes",
+		.function = write_bytes,
+		.anonymous = false
 	}
 };
 
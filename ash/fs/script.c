@@ -15,17 +15,23 @@
 */
 
 #include <assert.h>
+#include <limits.h>
+#include <stdatomic.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "ash/ash.h"
 #include "ash/bool.h"
+#include "ash/env.h"
 #include "ash/func.h"
 #include "ash/io.h"
 #include "ash/macro.h"
 #include "ash/mem.h"
+#include "ash/module.h"
 #include "ash/obj.h"
 #include "ash/ops.h"
+#include "ash/prof.h"
 #include "ash/script.h"
 #include "ash/str.h"
 #include "ash/type.h"
@@ -33,8 +39,19 @@
 #include "ash/lang/lang.h"
 #include "ash/lang/main.h"
 
+#ifdef ASH_PLATFORM_POSIX
+    #include <fcntl.h>
+    #include <pthread.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
 #define FILE_CHECK_SIZE 300
 
+/* the most threads used to parse a batch of scripts */
+#define SCRIPT_PARSE_THREADS 4
+
 #define ASH_SCRIPT_MAIN "__MAIN__"
 #define ASH_SCRIPT_FILE "__FILE__"
 
@@ -79,19 +96,60 @@ static void unset_script_vars(void)
     }
 }
 
+/*
+map the contents of a script read-only, tokens refer directly into
+the mapping so it lives as long as the script remains open
+*/
+static int ash_script_map(struct file *file, const char *name)
+{
+    int fd;
+    void *text;
+    struct stat st;
+
+    if ((fd = open(name, O_RDONLY | O_CLOEXEC)) == -1)
+        return -1;
+
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return -1;
+    }
+
+    file->mapped = false;
+    file->length = st.st_size;
+    file->text = "";
+    file->mtime = st.st_mtim.tv_sec;
+    file->mtime_nsec = st.st_mtim.tv_nsec;
+
+    if (st.st_size > 0) {
+        text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (text == MAP_FAILED) {
+            close(fd);
+            return -1;
+        }
+        file->text = text;
+        file->mapped = true;
+    }
+
+    close(fd);
+    return 0;
+}
+
 struct script *
 ash_script_open(const char *name, bool main)
 {
-    const char *content;
-    if (!(content = ash_io_read(name)))
+    struct file file;
+    if (ash_script_map(&file, name))
         return NULL;
 
     struct script *script;
     script = ash_alloc(sizeof *script);
     script->file.path = ash_strcpy(name);
     script->file.name = NULL;
-    script->file.text = content;
-    script->file.length = strlen(content);
+    script->file.text = file.text;
+    script->file.length = file.length;
+    script->file.mapped = file.mapped;
+    script->file.mtime = file.mtime;
+    script->file.mtime_nsec = file.mtime_nsec;
     script->main = main;
     script->open = ASH_FLAG_RESET;
     script->exec = ASH_FLAG_RESET;
@@ -106,48 +164,262 @@ void ash_script_close(struct script *script)
 
     if (script->file.path)
         ash_free((char *)script->file.path);
-    if (script->file.text)
-        ash_free((char *)script->file.text);
+    if (script->file.mapped)
+        munmap((void *)script->file.text, script->file.length);
     ash_free(script);
 }
 
-int ash_script_exec(struct script *script)
+/*
+a script opened and parsed ahead of being run as part of a batch;
+`parsed` is NULL if it did not parse, it is then streamed instead
+*/
+struct script_ahead {
+    struct script *script;
+    struct ash_main_parsed *parsed;
+};
+
+static int script_exec(struct script *script, struct ash_main_parsed *parsed)
 {
     assert(script != NULL);
 
     struct input input;
+    struct ash_prof_frame frame;
     input_script_init(&input, script);
 
     script->exec = ASH_FLAG_SET;
     set_script_vars(script);
-    ash_main_input(&input);
+    ash_prof_push(&frame, script->file.path);
+    if (parsed)
+        ash_main_parsed_exec(parsed);
+    else
+        ash_main_input(&input);
+    ash_prof_pop(&frame);
     unset_script_vars();
     return 0;
 }
 
-/*
-  load and execute a given script
-*/
-int ash_script_load(const char *name, bool main)
+int ash_script_exec(struct script *script)
+{
+    return script_exec(script, NULL);
+}
+
+/* load a script, using the parse of it made ahead if there is one */
+static int script_load(const char *name, bool main, struct script_ahead *ahead)
 {
     int status = -1;
     struct script *script;
-    if ((script = ash_script_open(name, main))) {
+
+    if (ahead && ahead->script) {
+        status = script_exec(ahead->script, ahead->parsed);
+        ash_script_close(ahead->script);
+        ahead->script = NULL;
+        ahead->parsed = NULL;
+    } else if ((script = ash_script_open(name, main))) {
         status = ash_script_exec(script);
         ash_script_close(script);
     }
     return status;
 }
 
+/*
+  load and execute a given script
+*/
+int ash_script_load(const char *name, bool main)
+{
+    return script_load(name, main, NULL);
+}
+
+static void script_module_file(struct ash_module_file *file, struct stat *st)
+{
+    file->mtime = st->st_mtim.tv_sec;
+    file->mtime_nsec = st->st_mtim.tv_nsec;
+    file->size = st->st_size;
+    file->ino = st->st_ino;
+}
+
+/*
+  whether a script is to be run by require: 0 when it is, with its
+  real path and file info set, 1 when it has been loaded already
+  and -1 when it cannot be found
+*/
+static int script_required(const char *name, bool reload, char *real,
+                           struct ash_module_file *file)
+{
+    struct stat st;
+    struct ash_module_file loaded;
+
+    if (!realpath(name, real) || stat(real, &st) == -1)
+        return -1;
+
+    script_module_file(file, &st);
+    if (ash_module_loaded(real, &loaded)) {
+        if (!reload || ash_module_file_eq(file, &loaded))
+            return 1;
+    }
+    return 0;
+}
+
+static int script_require(const char *name, bool reload,
+                          struct script_ahead *ahead)
+{
+    int status;
+    char real[PATH_MAX];
+    struct ash_module_file file;
+
+    if ((status = script_required(name, reload, real, &file)))
+        return status;
+
+    /* recorded before it runs, so a script may load itself */
+    ash_module_load(real, &file);
+    if ((status = script_load(name, false, ahead)) == -1)
+        ash_module_unload(real);
+    return status;
+}
+
+/*
+  load and execute a script unless it has been loaded already;
+  on reload it is run again if the file has changed since.
+  returns 0 when the script was run, 1 when it was not and
+  -1 when it could not be opened
+*/
+int ash_script_require(const char *name, bool reload)
+{
+    return script_require(name, reload, NULL);
+}
+
+struct script_batch {
+    size_t count;
+    struct script_ahead *ahead;
+    atomic_size_t next;
+};
+
+static void *script_batch_worker(void *arg)
+{
+    size_t i;
+    struct input input;
+    struct script_batch *batch = arg;
+
+    while ((i = atomic_fetch_add(&batch->next, 1)) < batch->count) {
+        if (!batch->ahead[i].script)
+            continue;
+        input_script_init(&input, batch->ahead[i].script);
+        batch->ahead[i].parsed = ash_main_parse_ahead(&input);
+    }
+    return NULL;
+}
+
+/*
+  scan and parse the scripts of a batch on a few threads, this
+  thread among them; only running them is left to be in order
+*/
+static void script_batch_parse(struct script_batch *batch)
+{
+    size_t threads, started = 0;
+    pthread_t thread[SCRIPT_PARSE_THREADS - 1];
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    threads = (cpus > 0) ? (size_t) cpus: 1;
+    if (threads > SCRIPT_PARSE_THREADS)
+        threads = SCRIPT_PARSE_THREADS;
+    if (threads > batch->count)
+        threads = batch->count;
+
+    atomic_init(&batch->next, 0);
+    for (size_t i = 1; i < threads; ++i) {
+        if (!pthread_create(&thread[started], NULL,
+                            script_batch_worker, batch))
+            started++;
+    }
+
+    script_batch_worker(batch);
+    for (size_t i = 0; i < started; ++i)
+        pthread_join(thread[i], NULL);
+}
+
+static void script_batch_init(struct script_batch *batch, size_t count)
+{
+    batch->count = count;
+    batch->ahead = ash_zalloc((sizeof *batch->ahead) * (count ? count: 1));
+}
+
+/* close the scripts of a batch that were never run */
+static void script_batch_destroy(struct script_batch *batch)
+{
+    for (size_t i = 0; i < batch->count; ++i) {
+        if (batch->ahead[i].parsed)
+            ash_main_parsed_destroy(batch->ahead[i].parsed);
+        if (batch->ahead[i].script)
+            ash_script_close(batch->ahead[i].script);
+    }
+    ash_free(batch->ahead);
+}
+
+/*
+  load and execute each of the given scripts in order, as with
+  ash_script_load. returns -1 if any could not be opened
+*/
+int ash_script_load_all(size_t count, const char * const *names)
+{
+    int status = 0;
+    struct script_batch batch;
+
+    script_batch_init(&batch, count);
+    for (size_t i = 0; i < count; ++i)
+        batch.ahead[i].script = ash_script_open(names[i], false);
+    script_batch_parse(&batch);
+
+    for (size_t i = 0; i < count; ++i) {
+        if (script_load(names[i], false, &batch.ahead[i]) == -1)
+            status = -1;
+    }
+
+    script_batch_destroy(&batch);
+    return status;
+}
+
+/*
+  require each of the given scripts in order, as with
+  ash_script_require, stopping at the first that cannot be
+  opened. returns its index, or -1 when there was none
+*/
+isize ash_script_require_all(size_t count, const char * const *names,
+                             bool reload)
+{
+    isize failed = -1;
+    char real[PATH_MAX];
+    struct ash_module_file file;
+    struct script_batch batch;
+
+    script_batch_init(&batch, count);
+    for (size_t i = 0; i < count; ++i) {
+        if (!script_required(names[i], reload, real, &file))
+            batch.ahead[i].script = ash_script_open(names[i], false);
+    }
+    script_batch_parse(&batch);
+
+    /* an earlier script may load a later one, so each is checked again */
+    for (size_t i = 0; i < count; ++i) {
+        if (script_require(names[i], reload, &batch.ahead[i]) == -1) {
+            failed = i;
+            break;
+        }
+    }
+
+    script_batch_destroy(&batch);
+    return failed;
+}
+
 int ash_script_exec_entry(struct script *script, struct ash_obj *args)
 {
     assert(script != NULL);
 
     struct input input;
+    struct ash_prof_frame frame;
     input_script_init(&input, script);
 
     script->exec = ASH_FLAG_SET;
     set_script_vars(script);
+    ash_prof_push(&frame, script->file.path);
     ash_main_input(&input);
 
     struct ash_var *av;
@@ -160,6 +432,7 @@ int ash_script_exec_entry(struct script *script, struct ash_obj *args)
             ash_func_exec(entry, &env, args);
     }
 
+    ash_prof_pop(&frame);
     unset_script_vars();
     return 0;
 }
@@ -174,6 +447,11 @@ const char *ash_script_content(struct script *script)
     return script->file.text;
 }
 
+size_t ash_script_length(struct script *script)
+{
+    return script->file.length;
+}
+
 static int ash_script_tilde(const char *script)
 {
     int status;
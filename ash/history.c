@@ -14,10 +14,17 @@
    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <string.h>
+
 #include "ash/ash.h"
 #include "ash/history.h"
+#include "ash/io.h"
+#include "ash/term/index.h"
 #include "ash/term/term.h"
 
+/* the most matches listed by a search */
+#define ASH_HISTORY_MATCHES 10
+
 enum history_flag_option {
     CLEAR = 1 << 0
 };
@@ -27,9 +34,11 @@ static const char *USAGE =
     "    manipulate the shell history\n"
     "usage:\n"
     "    history [FLAGS]\n"
+    "    history -s <TEXT>\n"
     "\n"
     "FLAGS:\n"
-    "    -c                 Clear history\n";
+    "    -c                 Clear history\n"
+    "    -s <TEXT>          Search history, best matches first\n";
 
 const char *ash_history_usage(void)
 {
@@ -55,6 +64,19 @@ static ash_flag ash_history_option(const char *s)
     return options;
 }
 
+static int ash_history_search(const char *text)
+{
+    const char *matches[ASH_HISTORY_MATCHES];
+    size_t count;
+
+    ash_term_open();
+    count = ash_term_index_search(text, matches, ASH_HISTORY_MATCHES);
+    for (size_t i = 0; i < count; ++i)
+        ash_print("%s\n", matches[i]);
+
+    return (count) ? ASH_STATUS_OK: ASH_STATUS_ERR;
+}
+
 int ash_history(int argc, const char * const *argv)
 {
     if (argc == 1)
@@ -66,7 +88,11 @@ int ash_history(int argc, const char * const *argv)
     for (int i = 1; i < argc; ++i) {
         opt = argv[i];
 
-        if (opt[0] == '-') {
+        if (!strcmp(opt, "-s")) {
+            if (i + 1 < argc)
+                return ash_history_search(argv[i + 1]);
+            return ASH_STATUS_ERR;
+        } else if (opt[0] == '-') {
             ash_flag n;
             if ((n = ash_history_option(&opt[1])))
                 options |= n;
@@ -0,0 +1,1181 @@
+/* Copyright 2018 eomain
+   this program is licensed under the 2-clause BSD license
+   see COPYING for the full license info
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ash/env.h"
+#include "ash/mem.h"
+#include "ash/ops.h"
+#include "ash/script.h"
+#include "ash/type.h"
+#include "ash/lang/ast.h"
+#include "ash/lang/cache.h"
+
+#ifdef ASH_PLATFORM_POSIX
+    #include <dirent.h>
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <time.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+/*
+a parsed script is cached as a header, the path of the script
+and then each of its top-level statements in the order they are
+run; nodes are written depth first with a tag for their type and
+a flag for each optional node, lists end with a zero flag
+*/
+
+#define CACHE_MAGIC   "ASHC"
+/* increment whenever the ast or its encoding changes */
+#define CACHE_VERSION 2
+#define CACHE_BUFSIZ  65536
+#define CACHE_NONE    UINT32_MAX
+#define CACHE_SUFFIX  ".ashc"
+
+/* entries not rewritten for this many seconds are removed */
+#define CACHE_MAX_AGE  (30 * 24 * 60 * 60)
+/* the most space the entries may take up together */
+#define CACHE_MAX_SIZE (64 * 1024 * 1024)
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME  0x100000001b3ULL
+
+struct cache_header {
+    char magic[4];
+    uint32_t version;
+    /* the script as it was when parsed */
+    uint64_t size;
+    int64_t mtime;
+    int64_t mtime_nsec;
+    uint64_t hash;
+    /* the path and statements that follow the header */
+    uint64_t length;
+    uint64_t check;
+};
+
+static uint64_t cache_hash(uint64_t hash, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    while (len--) {
+        hash ^= *p++;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static char *cache_dir(void)
+{
+    const char *dir;
+
+    if ((dir = getenv(ASH_CACHE_ENV)))
+        return (*dir) ? (char *) ash_strcpy(dir): NULL;
+    if ((dir = getenv("XDG_CACHE_HOME")) && *dir)
+        return (char *) ash_strcat(dir, "/ash");
+    if ((dir = getenv("HOME")) && *dir)
+        return (char *) ash_strcat(dir, "/.cache/ash");
+    return NULL;
+}
+
+/* the cache file of a script, named by the hash of its real path */
+static char *cache_path(struct script *script, char **source, char **dir)
+{
+    char *real, *path;
+    size_t size;
+
+    if (!(*dir = cache_dir()))
+        return NULL;
+    if (!(real = realpath(ash_script_name(script), NULL))) {
+        ash_free(*dir);
+        return NULL;
+    }
+
+    size = strlen(*dir) + 18 + sizeof CACHE_SUFFIX;
+    path = ash_alloc(size);
+    snprintf(path, size, "%s/%016" PRIx64 CACHE_SUFFIX, *dir,
+             cache_hash(FNV_OFFSET, real, strlen(real)));
+    *source = (char *) ash_strcpy(real);
+    free(real);
+    return path;
+}
+
+static void cache_header_init(struct cache_header *header,
+                              struct script *script)
+{
+    memset(header, 0, sizeof *header);
+    memcpy(header->magic, CACHE_MAGIC, sizeof header->magic);
+    header->version = CACHE_VERSION;
+    header->size = ash_script_length(script);
+    header->mtime = script->file.mtime;
+    header->mtime_nsec = script->file.mtime_nsec;
+    header->hash = cache_hash(FNV_OFFSET, ash_script_content(script),
+                              ash_script_length(script));
+}
+
+struct cache_writer {
+    int fd;
+    char *path;
+    char *temp;
+    struct cache_header header;
+    char *buf;
+    size_t len;
+    bool error;
+};
+
+static void cache_write(struct cache_writer *w, const void *data, size_t len)
+{
+    const char *p = data;
+    ssize_t n;
+
+    w->header.check = cache_hash(w->header.check, data, len);
+    w->header.length += len;
+    while (len > 0 && !w->error) {
+        if ((n = write(w->fd, p, len)) == -1) {
+            if (errno != EINTR)
+                w->error = true;
+            continue;
+        }
+        p += n;
+        len -= n;
+    }
+}
+
+static void cache_flush(struct cache_writer *w)
+{
+    cache_write(w, w->buf, w->len);
+    w->len = 0;
+}
+
+static void put(struct cache_writer *w, const void *data, size_t len)
+{
+    if (w->len + len > CACHE_BUFSIZ)
+        cache_flush(w);
+    if (len > CACHE_BUFSIZ) {
+        cache_write(w, data, len);
+        return;
+    }
+    memcpy(w->buf + w->len, data, len);
+    w->len += len;
+}
+
+static inline void put_u8(struct cache_writer *w, uint8_t value)
+{
+    put(w, &value, sizeof value);
+}
+
+static inline void put_size(struct cache_writer *w, size_t size)
+{
+    uint64_t value = size;
+    put(w, &value, sizeof value);
+}
+
+static inline void put_isize(struct cache_writer *w, isize num)
+{
+    int64_t value = num;
+    put(w, &value, sizeof value);
+}
+
+static void put_str(struct cache_writer *w, const char *s)
+{
+    uint32_t len = (s) ? strlen(s): CACHE_NONE;
+    put(w, &len, sizeof len);
+    if (s)
+        put(w, s, len);
+}
+
+static void put_expr(struct cache_writer *, struct ast_expr *);
+static void put_stm(struct cache_writer *, struct ast_stm *);
+
+static void put_path(struct cache_writer *w, struct ast_path *path)
+{
+    struct ast_scope *scope;
+
+    put_u8(w, path != NULL);
+    if (!path)
+        return;
+    put_u8(w, path->type);
+    put_size(w, path->length);
+    for (scope = path->path; scope; scope = scope->next) {
+        put_u8(w, 1);
+        put_str(w, scope->id);
+    }
+    put_u8(w, 0);
+}
+
+static void put_var(struct cache_writer *w, struct ast_var *var)
+{
+    put_u8(w, var != NULL);
+    if (!var)
+        return;
+    put_str(w, var->id);
+    put_u8(w, var->ref);
+    put_path(w, var->path);
+}
+
+static void put_composite(struct cache_writer *w, struct ast_composite *comp)
+{
+    put_u8(w, comp != NULL);
+    if (!comp)
+        return;
+    put_expr(w, comp->expr);
+    put_size(w, comp->length);
+}
+
+static void put_map(struct cache_writer *w, struct ast_map *map)
+{
+    struct ast_entry *entry;
+
+    put_u8(w, map != NULL);
+    if (!map)
+        return;
+    for (entry = map->entry; entry; entry = entry->next) {
+        put_u8(w, 1);
+        put_str(w, entry->key);
+        put_expr(w, entry->expr);
+    }
+    put_u8(w, 0);
+}
+
+static void put_function(struct cache_writer *w, struct ast_function *func)
+{
+    struct ast_param *param;
+
+    put_u8(w, func != NULL);
+    if (!func)
+        return;
+    put_str(w, func->id);
+    for (param = func->param; param; param = param->next) {
+        put_u8(w, 1);
+        put_str(w, param->id);
+    }
+    put_u8(w, 0);
+    put_stm(w, func->stm);
+}
+
+static void put_literal(struct cache_writer *w, struct ast_literal *literal)
+{
+    put_u8(w, literal->type);
+    switch (literal->type) {
+        case AST_LITERAL_BOOL:
+            put_u8(w, literal->value.boolean);
+            break;
+        case AST_LITERAL_NUM:
+            put_isize(w, literal->value.numeric);
+            break;
+        case AST_LITERAL_STR:
+            put_str(w, literal->value.string);
+            break;
+        case AST_LITERAL_ARRAY:
+            put_composite(w, literal->value.array);
+            break;
+        case AST_LITERAL_TUPLE:
+            put_composite(w, literal->value.tuple);
+            break;
+        case AST_LITERAL_RANGE:
+            put_isize(w, literal->value.range->start);
+            put_isize(w, literal->value.range->end);
+            put_u8(w, literal->value.range->inclusive);
+            break;
+        case AST_LITERAL_MAP:
+            put_map(w, literal->value.map);
+            break;
+        case AST_LITERAL_CLOSURE:
+            put_function(w, literal->value.closure);
+            break;
+    }
+}
+
+static void put_value(struct cache_writer *w, struct ast_value *value)
+{
+    put_u8(w, value->type);
+    if (value->type == AST_VALUE_VAR)
+        put_var(w, value->value.var);
+    else
+        put_literal(w, value->value.literal);
+}
+
+static void put_bool_expr(struct cache_writer *w, struct ast_bool_expr *bexpr)
+{
+    put_u8(w, bexpr != NULL);
+    if (bexpr)
+        put_expr(w, bexpr->expr);
+}
+
+static void put_expr(struct cache_writer *w, struct ast_expr *expr)
+{
+    struct ast_case *ecase;
+
+    for (; expr; expr = expr->next) {
+        put_u8(w, 1);
+        put_u8(w, expr->type);
+        switch (expr->type) {
+            case AST_EXPR_VALUE:
+                put_value(w, expr->expr);
+                break;
+            case AST_EXPR_CALL: {
+                struct ast_call *call = expr->expr;
+                put_var(w, call->var);
+                put_composite(w, call->args);
+                break;
+            }
+            case AST_EXPR_UNARY: {
+                struct ast_unary *unary = expr->expr;
+                put_u8(w, unary->op);
+                put_expr(w, unary->expr);
+                break;
+            }
+            case AST_EXPR_BINARY: {
+                struct ast_binary *binary = expr->expr;
+                put_u8(w, binary->op);
+                put_expr(w, binary->e1);
+                put_expr(w, binary->e2);
+                break;
+            }
+            case AST_EXPR_CMP: {
+                struct ast_cmp *cmp = expr->expr;
+                put_u8(w, cmp->op);
+                put_expr(w, cmp->e1);
+                put_expr(w, cmp->e2);
+                break;
+            }
+            case AST_EXPR_LOGICAL: {
+                struct ast_logical *logical = expr->expr;
+                put_u8(w, logical->op);
+                put_expr(w, logical->e1);
+                put_expr(w, logical->e2);
+                break;
+            }
+            case AST_EXPR_TERNARY: {
+                struct ast_ternary *ternary = expr->expr;
+                put_bool_expr(w, ternary->cond);
+                put_expr(w, ternary->e1);
+                put_expr(w, ternary->e2);
+                break;
+            }
+            case AST_EXPR_MATCH: {
+                struct ast_match *match = expr->expr;
+                put_expr(w, match->expr);
+                for (ecase = match->ecase; ecase; ecase = ecase->next) {
+                    put_u8(w, 1);
+                    put_expr(w, ecase->expr);
+                    put_expr(w, ecase->eval);
+                }
+                put_u8(w, 0);
+                put_expr(w, match->otherwise);
+                break;
+            }
+            case AST_EXPR_HASH: {
+                struct ast_hash *hash = expr->expr;
+                put_str(w, hash->key);
+                put_expr(w, hash->expr);
+                break;
+            }
+            case AST_EXPR_SUBST: {
+                struct ast_subst *subst = expr->expr;
+                put_u8(w, subst->type);
+                put_stm(w, subst->stm);
+                break;
+            }
+        }
+    }
+    put_u8(w, 0);
+}
+
+static void put_command(struct cache_writer *w, struct ast_command *command)
+{
+    struct ast_io *io;
+
+    put_u8(w, command != NULL);
+    if (!command)
+        return;
+    put_expr(w, command->expr);
+    put_size(w, command->length);
+    for (io = command->io; io; io = io->next) {
+        put_u8(w, 1);
+        put_u8(w, io->type);
+        put_isize(w, io->fd);
+        put_expr(w, io->expr);
+    }
+    put_u8(w, 0);
+
+    put_u8(w, command->redirect != NULL);
+    if (command->redirect) {
+        put_u8(w, command->redirect->type);
+        put_command(w, command->redirect->command);
+    }
+}
+
+static void put_if(struct cache_writer *w, struct ast_if *ast_if)
+{
+    put_u8(w, ast_if != NULL);
+    if (!ast_if)
+        return;
+    put_bool_expr(w, ast_if->cond);
+    put_stm(w, ast_if->stm);
+    put_u8(w, ast_if->else_t != NULL);
+    if (ast_if->else_t) {
+        put_u8(w, ast_if->else_t->type);
+        if (ast_if->else_t->type == AST_ELSE)
+            put_stm(w, ast_if->else_t->stm.stm);
+        else
+            put_if(w, ast_if->else_t->stm.if_t);
+    }
+}
+
+static void put_stm(struct cache_writer *w, struct ast_stm *stm)
+{
+    for (; stm; stm = stm->next) {
+        put_u8(w, 1);
+        put_u8(w, stm->type);
+        put_size(w, stm->line);
+        switch (stm->type) {
+            case AST_NODE_MODULE: {
+                struct ast_module *module = stm->node;
+                put_str(w, module->name);
+                put_stm(w, module->stm);
+                break;
+            }
+            case AST_NODE_COMMAND:
+                put_command(w, stm->node);
+                break;
+            case AST_NODE_EXPR:
+                put_expr(w, stm->node);
+                break;
+            case AST_NODE_ASSIGN: {
+                struct ast_assign *assign = stm->node;
+                put_u8(w, assign->local);
+                put_var(w, assign->var);
+                put_expr(w, assign->expr);
+                break;
+            }
+            case AST_NODE_IF:
+                put_if(w, stm->node);
+                break;
+            case AST_NODE_WHILE: {
+                struct ast_while *ast_while = stm->node;
+                put_bool_expr(w, ast_while->cond);
+                put_stm(w, ast_while->stm);
+                break;
+            }
+            case AST_NODE_FOR: {
+                struct ast_for *ast_for = stm->node;
+                put_var(w, ast_for->var);
+                put_expr(w, ast_for->expr);
+                put_stm(w, ast_for->stm);
+                break;
+            }
+            case AST_NODE_FUNC:
+                put_function(w, stm->node);
+                break;
+            case AST_NODE_RET: {
+                struct ast_return *ret = stm->node;
+                put_expr(w, ret->expr);
+                break;
+            }
+            case AST_NODE_BREAK:
+            case AST_NODE_NEXT:
+                break;
+        }
+    }
+    put_u8(w, 0);
+}
+
+/* create the cache directory and any missing parents */
+static int cache_mkdir(char *dir)
+{
+    char *p;
+
+    for (p = dir + 1; *p; ++p) {
+        if (*p != '/')
+            continue;
+        *p = '\0';
+        if (mkdir(dir, 0700) == -1 && errno != EEXIST) {
+            *p = '/';
+            return -1;
+        }
+        *p = '/';
+    }
+
+    if (mkdir(dir, 0700) == -1 && errno != EEXIST)
+        return -1;
+    return 0;
+}
+
+struct cache_entry {
+    char *path;
+    off_t size;
+    time_t mtime;
+};
+
+static int cache_entry_cmp(const void *a, const void *b)
+{
+    const struct cache_entry *x = a, *y = b;
+    return (x->mtime > y->mtime) - (x->mtime < y->mtime);
+}
+
+/*
+bound the cache as each new entry is written: entries not
+rewritten within CACHE_MAX_AGE are removed, as is a temporary
+file left as long by a writer that failed, then the oldest
+entries until the rest fit within CACHE_MAX_SIZE
+*/
+static void cache_evict(const char *dir)
+{
+    struct cache_entry *entries = NULL;
+    size_t len = 0, cap = 0, size;
+    uint64_t total = 0;
+    struct dirent *ent;
+    struct stat st;
+    const char *suffix;
+    char *path;
+    time_t now;
+    DIR *d;
+
+    if (!(d = opendir(dir)))
+        return;
+
+    now = time(NULL);
+    while ((ent = readdir(d))) {
+        if (!(suffix = strstr(ent->d_name, CACHE_SUFFIX)))
+            continue;
+
+        size = strlen(dir) + strlen(ent->d_name) + 2;
+        path = ash_alloc(size);
+        snprintf(path, size, "%s/%s", dir, ent->d_name);
+
+        if (lstat(path, &st) == -1 || !S_ISREG(st.st_mode)) {
+            ash_free(path);
+        } else if (now - st.st_mtime > CACHE_MAX_AGE) {
+            unlink(path);
+            ash_free(path);
+        } else if (suffix[sizeof CACHE_SUFFIX - 1] != '\0') {
+            /* a temporary file still being written */
+            ash_free(path);
+        } else {
+            if (len == cap) {
+                cap = (cap) ? cap * 2: 64;
+                entries = (entries) ?
+                    ash_realloc(entries, cap * sizeof *entries):
+                    ash_alloc(cap * sizeof *entries);
+            }
+            entries[len].path = path;
+            entries[len].size = st.st_size;
+            entries[len].mtime = st.st_mtime;
+            total += st.st_size;
+            len++;
+        }
+    }
+    closedir(d);
+
+    if (total > CACHE_MAX_SIZE)
+        qsort(entries, len, sizeof *entries, cache_entry_cmp);
+
+    for (size_t i = 0; i < len; ++i) {
+        if (total > CACHE_MAX_SIZE && unlink(entries[i].path) == 0)
+            total -= entries[i].size;
+        ash_free(entries[i].path);
+    }
+
+    if (entries)
+        ash_free(entries);
+}
+
+struct cache_writer *cache_writer_new(struct script *script)
+{
+    struct cache_writer *w;
+    char *path, *source, *dir;
+    size_t size;
+    int fd = -1;
+
+    if (!(path = cache_path(script, &source, &dir)))
+        return NULL;
+
+    size = strlen(path) + sizeof ".XXXXXX";
+    w = ash_alloc(sizeof *w);
+    w->path = path;
+    w->temp = ash_alloc(size);
+    snprintf(w->temp, size, "%s.XXXXXX", path);
+
+    if (cache_mkdir(dir) == 0) {
+        cache_evict(dir);
+        fd = mkstemp(w->temp);
+    }
+
+    if (fd == -1) {
+        ash_free(dir);
+        ash_free(source);
+        ash_free(w->temp);
+        ash_free(w->path);
+        ash_free(w);
+        return NULL;
+    }
+    ash_free(dir);
+
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    w->fd = fd;
+    w->buf = ash_alloc(CACHE_BUFSIZ);
+    w->len = 0;
+    w->error = false;
+    cache_header_init(&w->header, script);
+    w->header.check = FNV_OFFSET;
+
+    /* the header is written last, once the statements are known */
+    if (lseek(fd, sizeof w->header, SEEK_SET) == -1)
+        w->error = true;
+    put_str(w, source);
+    ash_free(source);
+    return w;
+}
+
+void cache_writer_add(struct cache_writer *w, struct ast_stm *stm, bool retain)
+{
+    put_u8(w, 1);
+    put_u8(w, retain);
+    put_stm(w, stm);
+}
+
+int cache_writer_commit(struct cache_writer *w)
+{
+    ssize_t n;
+
+    put_u8(w, 0);
+    cache_flush(w);
+    if (w->error)
+        return -1;
+
+    do {
+        n = pwrite(w->fd, &w->header, sizeof w->header, 0);
+    } while (n == -1 && errno == EINTR);
+    if (n != sizeof w->header)
+        return -1;
+
+    if (close(w->fd) == -1) {
+        w->fd = -1;
+        return -1;
+    }
+    w->fd = -1;
+
+    if (rename(w->temp, w->path) == -1)
+        return -1;
+    ash_free(w->temp);
+    w->temp = NULL;
+    return 0;
+}
+
+void cache_writer_destroy(struct cache_writer *w)
+{
+    if (w->fd != -1)
+        close(w->fd);
+    if (w->temp) {
+        unlink(w->temp);
+        ash_free(w->temp);
+    }
+    ash_free(w->path);
+    ash_free(w->buf);
+    ash_free(w);
+}
+
+/*
+statements are decoded from the mapping as they are run;
+a decoding error leaves the partial statement unfreed
+*/
+struct cache {
+    const char *map;
+    size_t size;
+    const char *pos;
+    const char *end;
+    bool error;
+};
+
+static bool get(struct cache *c, void *data, size_t len)
+{
+    if (c->error || len > (size_t) (c->end - c->pos)) {
+        c->error = true;
+        memset(data, 0, len);
+        return false;
+    }
+    memcpy(data, c->pos, len);
+    c->pos += len;
+    return true;
+}
+
+static inline uint8_t get_u8(struct cache *c)
+{
+    uint8_t value;
+    get(c, &value, sizeof value);
+    return value;
+}
+
+static inline size_t get_size(struct cache *c)
+{
+    uint64_t value;
+    get(c, &value, sizeof value);
+    return value;
+}
+
+static inline isize get_isize(struct cache *c)
+{
+    int64_t value;
+    get(c, &value, sizeof value);
+    return value;
+}
+
+static char *get_str(struct cache *c)
+{
+    uint32_t len;
+    char *s;
+
+    if (!get(c, &len, sizeof len) || len == CACHE_NONE)
+        return NULL;
+    if (len > (size_t) (c->end - c->pos)) {
+        c->error = true;
+        return NULL;
+    }
+    s = ast_strdup(c->pos, len);
+    c->pos += len;
+    return s;
+}
+
+static struct ast_expr *get_expr(struct cache *);
+static struct ast_stm *get_stm(struct cache *);
+
+static struct ast_path *get_path(struct cache *c)
+{
+    enum ash_module_path_type type;
+    struct ast_scope *scope = NULL, **tail = &scope;
+    size_t length;
+
+    if (!get_u8(c))
+        return NULL;
+    type = get_u8(c);
+    length = get_size(c);
+    while (get_u8(c)) {
+        *tail = ast_scope_new(get_str(c));
+        tail = &(*tail)->next;
+    }
+    return ast_path_new(type, length, scope);
+}
+
+static struct ast_var *get_var(struct cache *c)
+{
+    const char *id;
+    bool ref;
+
+    if (!get_u8(c))
+        return NULL;
+    id = get_str(c);
+    ref = get_u8(c);
+    return ast_var_new(id, ref, get_path(c));
+}
+
+static struct ast_composite *get_composite(struct cache *c)
+{
+    struct ast_expr *expr;
+
+    if (!get_u8(c))
+        return NULL;
+    expr = get_expr(c);
+    return ast_composite_new(expr, get_size(c));
+}
+
+static struct ast_map *get_map(struct cache *c)
+{
+    struct ast_entry *entry = NULL, **tail = &entry;
+    const char *key;
+
+    if (!get_u8(c))
+        return NULL;
+    while (get_u8(c)) {
+        key = get_str(c);
+        *tail = ast_entry_new(key, get_expr(c));
+        tail = &(*tail)->next;
+    }
+    return ast_map_new(entry);
+}
+
+static struct ast_function *get_function(struct cache *c)
+{
+    struct ast_param *param = NULL, **tail = &param;
+    const char *id;
+
+    if (!get_u8(c))
+        return NULL;
+    id = get_str(c);
+    while (get_u8(c)) {
+        *tail = ast_param_new(get_str(c));
+        tail = &(*tail)->next;
+    }
+    return ast_function_new(id, param, get_stm(c));
+}
+
+static struct ast_literal *get_literal(struct cache *c)
+{
+    isize start, end;
+
+    switch (get_u8(c)) {
+        case AST_LITERAL_BOOL:
+            return ast_literal_bool(get_u8(c));
+        case AST_LITERAL_NUM:
+            return ast_literal_num(get_isize(c));
+        case AST_LITERAL_STR:
+            return ast_literal_str(get_str(c));
+        case AST_LITERAL_ARRAY:
+            return ast_literal_array(get_composite(c));
+        case AST_LITERAL_TUPLE:
+            return ast_literal_tuple(get_composite(c));
+        case AST_LITERAL_RANGE:
+            start = get_isize(c);
+            end = get_isize(c);
+            return ast_literal_range(ast_range_new(start, end, get_u8(c)));
+        case AST_LITERAL_MAP:
+            return ast_literal_map(get_map(c));
+        case AST_LITERAL_CLOSURE:
+            return ast_literal_closure(get_function(c));
+    }
+
+    c->error = true;
+    return NULL;
+}
+
+static struct ast_value *get_value(struct cache *c)
+{
+    struct ast_literal *literal;
+
+    if (get_u8(c) == AST_VALUE_VAR)
+        return ast_value_var(get_var(c));
+    if (!(literal = get_literal(c)))
+        return NULL;
+    return ast_value_literal(literal);
+}
+
+static struct ast_bool_expr *get_bool_expr(struct cache *c)
+{
+    if (!get_u8(c))
+        return NULL;
+    return ast_bool_expr_new(get_expr(c));
+}
+
+static struct ast_expr *get_expr(struct cache *c)
+{
+    struct ast_expr *expr = NULL, **tail = &expr, *e1;
+    struct ast_case *ecase, **next;
+    enum ast_expr_type type;
+    void *node;
+    uint8_t op;
+
+    while (get_u8(c)) {
+        switch ((type = get_u8(c))) {
+            case AST_EXPR_VALUE:
+                node = get_value(c);
+                break;
+            case AST_EXPR_CALL: {
+                struct ast_var *var = get_var(c);
+                node = ast_call_new(var, get_composite(c));
+                break;
+            }
+            case AST_EXPR_UNARY:
+                op = get_u8(c);
+                node = ast_unary_new(op, get_expr(c));
+                break;
+            case AST_EXPR_BINARY:
+                op = get_u8(c);
+                e1 = get_expr(c);
+                node = ast_binary_new(op, e1, get_expr(c));
+                break;
+            case AST_EXPR_CMP:
+                op = get_u8(c);
+                e1 = get_expr(c);
+                node = ast_cmp_new(op, e1, get_expr(c));
+                break;
+            case AST_EXPR_LOGICAL:
+                op = get_u8(c);
+                e1 = get_expr(c);
+                node = ast_logical_new(op, e1, get_expr(c));
+                break;
+            case AST_EXPR_TERNARY: {
+                struct ast_bool_expr *cond = get_bool_expr(c);
+                e1 = get_expr(c);
+                node = ast_ternary_new(cond, e1, get_expr(c));
+                break;
+            }
+            case AST_EXPR_MATCH:
+                e1 = get_expr(c);
+                ecase = NULL;
+                next = &ecase;
+                while (get_u8(c)) {
+                    struct ast_expr *match = get_expr(c);
+                    *next = ast_case_new(match, get_expr(c), NULL);
+                    next = &(*next)->next;
+                }
+                node = ast_match_new(e1, ecase, get_expr(c));
+                break;
+            case AST_EXPR_HASH: {
+                const char *key = get_str(c);
+                node = ast_hash_new(key, get_expr(c));
+                break;
+            }
+            case AST_EXPR_SUBST:
+                op = get_u8(c);
+                node = ast_subst_new(op, get_stm(c));
+                break;
+            default:
+                c->error = true;
+                return expr;
+        }
+
+        if (c->error || !node) {
+            c->error = true;
+            return expr;
+        }
+        *tail = ast_expr_new(type, node);
+        tail = &(*tail)->next;
+    }
+
+    return expr;
+}
+
+static struct ast_command *get_command(struct cache *c)
+{
+    struct ast_command *command;
+    struct ast_expr *expr;
+    struct ast_io *io = NULL, **tail = &io;
+    enum ash_exec_redirect type;
+    size_t length;
+    int fd;
+
+    if (!get_u8(c))
+        return NULL;
+    expr = get_expr(c);
+    length = get_size(c);
+    while (get_u8(c)) {
+        type = get_u8(c);
+        fd = get_isize(c);
+        *tail = ast_io_new(type, fd, get_expr(c));
+        tail = &(*tail)->next;
+    }
+
+    command = ast_command_new(expr, length, io);
+    if (get_u8(c)) {
+        type = get_u8(c);
+        command->redirect = ast_command_redirect_new(type, get_command(c));
+    }
+    return command;
+}
+
+static struct ast_if *get_if(struct cache *c)
+{
+    struct ast_bool_expr *cond;
+    struct ast_stm *stm;
+    struct ast_else *else_t = NULL;
+
+    if (!get_u8(c))
+        return NULL;
+    cond = get_bool_expr(c);
+    stm = get_stm(c);
+    if (get_u8(c)) {
+        if (get_u8(c) == AST_ELSE)
+            else_t = ast_else_new(get_stm(c));
+        else
+            else_t = ast_else_if_new(get_if(c));
+    }
+    return ast_if_new(cond, stm, else_t);
+}
+
+static struct ast_stm *get_stm(struct cache *c)
+{
+    struct ast_stm *stm = NULL, **tail = &stm;
+    enum ast_node_type type;
+    void *node = NULL;
+    const char *name;
+    size_t line;
+    bool local;
+
+    while (get_u8(c)) {
+        type = get_u8(c);
+        line = get_size(c);
+        switch (type) {
+            case AST_NODE_MODULE:
+                name = get_str(c);
+                node = ast_module_new(name, get_stm(c));
+                break;
+            case AST_NODE_COMMAND:
+                node = get_command(c);
+                break;
+            case AST_NODE_EXPR:
+                node = get_expr(c);
+                break;
+            case AST_NODE_ASSIGN: {
+                struct ast_var *var;
+                local = get_u8(c);
+                var = get_var(c);
+                node = ast_assign_new(local, var, get_expr(c));
+                break;
+            }
+            case AST_NODE_IF:
+                node = get_if(c);
+                break;
+            case AST_NODE_WHILE: {
+                struct ast_bool_expr *cond = get_bool_expr(c);
+                node = ast_while_new(cond, get_stm(c));
+                break;
+            }
+            case AST_NODE_FOR: {
+                struct ast_var *var = get_var(c);
+                struct ast_expr *expr = get_expr(c);
+                node = ast_for_new(var, expr, get_stm(c));
+                break;
+            }
+            case AST_NODE_FUNC:
+                node = get_function(c);
+                break;
+            case AST_NODE_RET:
+                node = ast_return_new(get_expr(c));
+                break;
+            case AST_NODE_BREAK:
+            case AST_NODE_NEXT:
+                node = NULL;
+                break;
+            default:
+                c->error = true;
+                return stm;
+        }
+
+        if (c->error)
+            return stm;
+        *tail = ast_stm_new(type, node, line);
+        tail = &(*tail)->next;
+    }
+
+    return stm;
+}
+
+/* whether the cache can be trusted and matches the script */
+static bool cache_valid(const char *map, size_t size,
+                        struct script *script, const char *source)
+{
+    struct cache_header header, expect;
+    uint32_t len;
+    const char *path;
+
+    if (size < sizeof header + sizeof len)
+        return false;
+    memcpy(&header, map, sizeof header);
+    cache_header_init(&expect, script);
+
+    if (memcmp(header.magic, expect.magic, sizeof header.magic) ||
+        header.version != expect.version ||
+        header.size != expect.size ||
+        header.mtime != expect.mtime ||
+        header.mtime_nsec != expect.mtime_nsec ||
+        header.hash != expect.hash ||
+        header.length != size - sizeof header)
+        return false;
+
+    path = map + sizeof header;
+    memcpy(&len, path, sizeof len);
+    path += sizeof len;
+    if (len != strlen(source) || len > header.length - sizeof len ||
+        memcmp(path, source, len))
+        return false;
+
+    return header.check == cache_hash(FNV_OFFSET, map + sizeof header,
+                                      header.length);
+}
+
+struct cache *cache_load(struct script *script)
+{
+    struct cache *c;
+    struct stat st;
+    char *path, *source, *dir;
+    uint32_t len;
+    void *map;
+    int fd;
+
+    if (!(path = cache_path(script, &source, &dir)))
+        return NULL;
+    ash_free(dir);
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    ash_free(path);
+
+    /* only trust a cache that no one else could have written */
+    if (fd == -1 || fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) ||
+        st.st_uid != geteuid() || (st.st_mode & (S_IWGRP | S_IWOTH)) ||
+        (size_t) st.st_size < sizeof (struct cache_header)) {
+        if (fd != -1)
+            close(fd);
+        ash_free(source);
+        return NULL;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        ash_free(source);
+        return NULL;
+    }
+
+    if (!cache_valid(map, st.st_size, script, source)) {
+        munmap(map, st.st_size);
+        ash_free(source);
+        return NULL;
+    }
+
+    c = ash_alloc(sizeof *c);
+    c->map = map;
+    c->size = st.st_size;
+    c->pos = c->map + sizeof (struct cache_header);
+    c->end = c->map + c->size;
+    c->error = false;
+    /* the path of the script was checked by cache_valid */
+    memcpy(&len, c->pos, sizeof len);
+    c->pos += sizeof len + len;
+    ash_free(source);
+    return c;
+}
+
+int cache_next(struct cache *c, struct ast_stm **stm, bool *retain)
+{
+    struct ast_pool *pool, *prev;
+
+    if (!get_u8(c))
+        return (c->error) ? -1: 0;
+
+    *retain = get_u8(c);
+    pool = ast_pool_new();
+    prev = ast_pool_use(pool);
+    *stm = get_stm(c);
+    ast_pool_use(prev);
+
+    if (c->error || !*stm) {
+        ast_pool_destroy(pool);
+        *stm = NULL;
+        return -1;
+    }
+    return 1;
+}
+
+void cache_close(struct cache *c)
+{
+    munmap((void *) c->map, c->size);
+    ash_free(c);
+}
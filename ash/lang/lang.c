@@ -15,8 +15,10 @@
 */
 
 #include <assert.h>
+#include <ctype.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "ash/ash.h"
 #include "ash/env.h"
@@ -27,148 +29,118 @@
 #include "ash/lang/lang.h"
 #include "ash/lang/lex.h"
 
-static struct ash_tk *
-ash_tk_new(enum ash_tk_type type, const char *str)
+void
+ash_tk_set_add(struct ash_tk_set *set, enum ash_tk_type type, uint8_t flags,
+               size_t line, size_t offset, size_t len)
 {
     struct ash_tk *tk;
-    tk = ash_alloc(sizeof *tk);
-    tk->str = str;
-    tk->type = type;
-    tk->eos = false;
-    tk->next = NULL;
-    return tk;
-}
 
-struct ash_tk *
-ash_tk_next(struct ash_tk **tk)
-{
-    if (*tk == NULL)
-        return NULL;
-    assert(*tk);
-    *tk = (*tk)->next;
-    return *tk;
-}
+    if (!set->tokens) {
+        set->size = 64;
+        set->tokens = ash_alloc(set->size * sizeof *tk);
+    } else if (set->count == set->size) {
+        set->size *= 2;
+        set->tokens = ash_realloc(set->tokens, set->size * sizeof *tk);
+    }
 
-enum ash_tk_type
-ash_tk_get(struct ash_tk **tk)
-{
-    if (tk && *tk)
-        return (*tk)->type;
-    else
-        return NO_TK;
+    tk = &set->tokens[set->count++];
+    tk->type = type;
+    tk->flags = flags;
+    tk->line = line;
+    tk->offset = offset;
+    tk->len = len;
 }
 
-enum ash_tk_type
-ash_tk_getnext(struct ash_tk **tk)
+isize
+ash_tk_set_num(struct ash_tk_set *set, struct ash_tk *tk)
 {
-    ash_tk_next(tk);
-    return ash_tk_get(tk);
-}
+    isize num = 0;
+    const char *str;
 
-enum ash_tk_type
-ash_tk_cknext(struct ash_tk **tk)
-{
-    if (tk && *tk)
-        return ash_tk_get(&(*tk)->next);
-    else
-        return NO_TK;
-}
+    if (!(tk && (str = ash_tk_set_str(set, tk))))
+        return 0;
 
-bool
-ash_tk_eos(struct ash_tk **tk)
-{
-    if (tk && *tk)
-        return (*tk)->eos;
-    return false;
+    for (size_t i = 0; i < tk->len && isdigit(str[i]); ++i)
+        num = (num * 10) + (str[i] - '0');
+    return num;
 }
 
-bool ash_tk_get_eos(struct ash_tk **tk)
+/*
+the column of an offset into the text of the set; it is only
+needed to report an error, so it is not kept with each token
+*/
+size_t
+ash_tk_set_column(struct ash_tk_set *set, size_t offset)
 {
-    enum ash_tk_type type;
-    type = ash_tk_get(tk);
-    if (ash_tk_cknext(tk) == SEM_TK) {
-        ash_tk_next(tk);
-        return true;
-    }
-    else if (ash_tk_eos(tk))
-        return true;
+    size_t start;
 
-    return false;
-}
+    if (!set->text)
+        return offset + 1;
 
-const char *
-ash_tk_strcpy(struct ash_tk **tk)
-{
-    if (tk && *tk && (*tk)->str)
-        return ash_strcpy((*tk)->str);
-    return NULL;
+    if (offset > set->length)
+        offset = set->length;
+    for (start = offset; start > 0 && set->text[start - 1] != '\n'; --start)
+        ;
+    return (offset - start) + 1;
 }
 
-isize
-ash_tk_num(struct ash_tk **tk)
+/*
+append more input to the text of the set, copying the text
+into a buffer owned by the set; the lines of the text are
+kept apart. returns where the input now begins
+*/
+const char *
+ash_tk_set_extend(struct ash_tk_set *set, const char *input, size_t length)
 {
-    if (tk && *tk && (*tk)->str)
-        return atol((*tk)->str);
-    return 0;
-}
+    char *buffer;
+    size_t at = 0;
 
-int
-ash_tk_assert_type(struct ash_tk **tk, enum ash_tk_type type)
-{
-    if (ash_tk_get(tk) != type)
-        return -1;
-    return 0;
-}
+    if (set->text)
+        at = set->length + 1;
 
-struct ash_tk *
-ash_tk_set_front(struct ash_tk_set *set)
-{
-    return set->front;
+    buffer = ash_alloc(at + length + 1);
+    if (set->text) {
+        memcpy(buffer, set->text, set->length);
+        buffer[set->length] = '\n';
+    }
+    memcpy(buffer + at, input, length);
+    buffer[at + length] = '\0';
+
+    if (set->buffer)
+        ash_free(set->buffer);
+    set->buffer = buffer;
+    set->text = buffer;
+    set->length = at + length;
+    return buffer + at;
 }
 
+/* release the tokens in front of a given index */
 void
-ash_tk_set_add(struct ash_tk_set *set, enum ash_tk_type type,
-               const char *string, struct ash_tk_meta *meta)
+ash_tk_set_release(struct ash_tk_set *set, size_t upto)
 {
-    struct ash_tk *tk;
-    tk = ash_tk_new(type, string);
+    size_t n;
 
-    tk->line = meta->line;
-    tk->offset = meta->offset;
+    if (upto <= set->base)
+        return;
 
-    if (set->rear) {
-        set->rear->next = tk;
-        set->rear = tk;
+    if (upto >= ash_tk_set_end(set)) {
+        set->count = 0;
     } else {
-        set->front = set->rear = tk;
+        n = upto - set->base;
+        set->count -= n;
+        memmove(set->tokens, set->tokens + n, set->count * sizeof *set->tokens);
     }
+    set->base = upto;
 }
 
-static void
-ash_tk_set_free(struct ash_tk_set *set)
-{
-    if (!set->front)
-        return;
-
-    struct ash_tk *tk = set->front, *n;
-    do {
-        n = tk->next;
-        if (tk->str)
-            ash_free((void *)tk->str);
-        tk->str = NULL;
-        tk->next = NULL;
-        ash_free(tk);
-    } while((tk = n));
-
-    set->front = NULL;
-    set->rear = NULL;
-}
-
-static void
-ash_tk_set_append(struct ash_tk_set *set, struct ash_tk_set *s)
+void
+ash_tk_set_destroy(struct ash_tk_set *set)
 {
-    set->rear->next = s->front;
-    set->rear = s->rear;
+    if (set->tokens)
+        ash_free(set->tokens);
+    if (set->buffer)
+        ash_free(set->buffer);
+    ash_tk_set_init(set);
 }
 
 static inline bool ash_lang_is_block(enum ash_tk_type type)
@@ -178,39 +150,48 @@ static inline bool ash_lang_is_block(enum ash_tk_type type)
             type == MOD_TK || type == MAT_TK);
 }
 
-static inline struct ash_tk *
-prompt(struct ash_tk_set *set, struct ash_tk_set *s)
+/*
+scan the next line of input onto the end of the set; returns
+the index of the first token added. a line that fails to scan
+adds no tokens
+*/
+static inline size_t
+prompt(struct ash_tk_set *set)
 {
-    struct ash_tk *token;
-    ash_tk_set_init(s);
-    if (lex_scan_input(s, ash_scan("| ")))
-        return NULL;
+    size_t from, length;
+    const char *input;
 
-    if ((token = s->front))
-        ash_tk_set_append(set, s);
+    from = ash_tk_set_end(set);
+    if (!(input = ash_scan(ash_prompt_next())))
+        return from;
 
-    return token;
+    length = strlen(input);
+    input = ash_tk_set_extend(set, input, length);
+    if (lex_scan_input(set, input, length))
+        set->count = from - set->base;
+
+    return from;
 }
 
 static int prompt_block(struct ash_tk_set *);
 
 static int prompt_command(struct ash_tk_set *set)
 {
-    struct ash_tk *next;
-    struct ash_tk_set s;
+    size_t next;
+    struct ash_tk *tk;
 
     for (;;) {
-        if (!(next = prompt(set, &s)))
-            continue;
+        next = prompt(set);
 
-        for (; next != NULL; next = next->next) {
-            if (ash_lang_is_block(next->type)) {
+        for (; (tk = ash_tk_set_get(set, next)); ++next) {
+            if (ash_lang_is_block(tk->type)) {
                 if (prompt_block(set))
                     return -1;
-                next = set->rear;
+                next = ash_tk_set_end(set) - 1;
+                tk = ash_tk_set_get(set, next);
             }
 
-            if (next->type == SEM_TK)
+            if (tk->type == SEM_TK)
                 return 0;
         }
     }
@@ -221,17 +202,16 @@ static int prompt_command(struct ash_tk_set *set)
 static int prompt_block(struct ash_tk_set *set)
 {
     long level = 1;
-    struct ash_tk *next;
-    struct ash_tk_set s;
+    size_t next;
+    struct ash_tk *tk;
 
     do {
-        if (!(next = prompt(set, &s)))
-            continue;
+        next = prompt(set);
 
-        for (; next != NULL; next = next->next) {
-            if (ash_lang_is_block(next->type))
+        for (; (tk = ash_tk_set_get(set, next)); ++next) {
+            if (ash_lang_is_block(tk->type))
                 ++level;
-            else if (next->type == END_TK)
+            else if (tk->type == END_TK)
                 --level;
         }
     } while (level != 0);
@@ -277,6 +257,8 @@ static const char *ash_token_names[] = {
     [ LB_TK  ]   = "{",
     [ RB_TK  ]   = "}",
     [ BQ_TK  ]   = "`",
+    [ CS_TK  ]   = "$(...)",
+    [ CSL_TK ]   = "$<(...)",
     [ SQT_TK ]   = "'",
     [ DQT_TK ]   = "\"",
     [ CO_TK  ]   = ",",
@@ -298,6 +280,11 @@ static const char *ash_token_names[] = {
     [ LE_TK  ]   = "<=",
     [ GE_TK  ]   = ">=",
     [ PIP_TK ]   = "|",
+    [ RDO_TK ]   = ">",
+    [ RDA_TK ]   = ">>",
+    [ RDI_TK ]   = "<",
+    [ RDD_TK ]   = ">&",
+    [ RDS_TK ]   = "<<<",
     [ BS_TK  ]   = "\\",
     [ QMK_TK ]   = "?",
     [ VAR_TK ]   = "<id>",
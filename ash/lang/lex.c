@@ -23,14 +23,49 @@
 #include "ash/lang/lang.h"
 #include "ash/lang/lex.h"
 
+/*
+the token type each character begins, NO_TK being that of the
+characters that may only appear within a word (VAR_TK)
+*/
+static const unsigned char lex_table[256] = {
+    [' ']  = WS_TK,  ['\0'] = WS_TK,  ['\t'] = WS_TK,
+    ['\v'] = WS_TK,  ['\r'] = WS_TK,  ['\f'] = WS_TK,
+
+    ['\n'] = EOS_TK, [';']  = SEM_TK,
+
+    ['$']  = AV_TK,  ['#']  = CM_TK,  ['`']  = BQ_TK,
+    ['\''] = SQT_TK, ['"']  = DQT_TK,
+
+    ['\\'] = BS_TK,  ['|']  = PIP_TK, ['?']  = QMK_TK,
+
+    [':']  = CN_TK,  ['[']  = LS_TK,  [']']  = RS_TK,
+    ['(']  = LP_TK,  [')']  = RP_TK,  ['{']  = LB_TK,
+    ['}']  = RB_TK,
+
+    ['<']  = LN_TK,  ['>']  = GN_TK,  ['=']  = EQ_TK,
+
+    [',']  = CO_TK,
+
+    ['0']  = NUM_TK, ['1']  = NUM_TK, ['2']  = NUM_TK,
+    ['3']  = NUM_TK, ['4']  = NUM_TK, ['5']  = NUM_TK,
+    ['6']  = NUM_TK, ['7']  = NUM_TK, ['8']  = NUM_TK,
+    ['9']  = NUM_TK
+};
+
+/* the characters that end a word, that is all but VAR, NUM and EQ */
+static const bool lex_word_end[256] = {
+    [' ']  = true, ['\0'] = true, ['\t'] = true, ['\v'] = true,
+    ['\r'] = true, ['\f'] = true, ['\n'] = true, [';']  = true,
+    ['$']  = true, ['#']  = true, ['`']  = true, ['\''] = true,
+    ['"']  = true, ['\\'] = true, ['|']  = true, ['?']  = true,
+    [':']  = true, ['[']  = true, [']']  = true, ['(']  = true,
+    [')']  = true, ['{']  = true, ['}']  = true, ['<']  = true,
+    ['>']  = true, [',']  = true
+};
+
 static inline bool lex_is_ws(char c)
 {
-    return (c == ' '  ||
-            c == '\0' ||
-            c == '\t' ||
-            c == '\v' ||
-            c == '\r' ||
-            c == '\f');
+    return (lex_table[(unsigned char) c] == WS_TK);
 }
 
 static inline bool lex_is_numeric(char c)
@@ -38,232 +73,131 @@ static inline bool lex_is_numeric(char c)
     return (c >= '0' && c <= '9');
 }
 
-static enum ash_tk_type lex_token_type(char c)
+static inline enum ash_tk_type lex_token_type(char c)
 {
-    if (lex_is_ws(c))
-        return WS_TK;
-
-    switch (c) {
-        case '\n':  return EOS_TK;
-        case ';':   return SEM_TK;
-
-        case '$':   return AV_TK;
-        case '#':   return CM_TK;
-        case '`':   return BQ_TK;
-        case '\'':  return SQT_TK;
-        case '\"':  return DQT_TK;
-
-        case '\\':  return BS_TK;
-        case '|':   return PIP_TK;
-        case '?':   return QMK_TK;
-
-        case ':':   return CN_TK;
-        case '[':   return LS_TK;
-        case ']':   return RS_TK;
-        case '(':   return LP_TK;
-        case ')':   return RP_TK;
-        case '{':   return LB_TK;
-        case '}':   return RB_TK;
+    enum ash_tk_type type;
+    type = lex_table[(unsigned char) c];
+    return (type != NO_TK) ? type: VAR_TK;
+}
 
-        case '<':   return LN_TK;
-        case '>':   return GN_TK;
-        case '=':   return EQ_TK;
+/* the shortest and longest keyword */
+#define LEX_KEYWORD_MIN 2
+#define LEX_KEYWORD_MAX 6
 
-        case ',':   return CO_TK;
+/*
+keywords are found by a perfect hash of their first and last
+characters and their length, so that a word is compared with
+at most one of them
+*/
+#define LEX_KEYWORD_HASH(s, len) \
+    (((unsigned char) (s)[0] + 3 * (unsigned char) (s)[(len) - 1] + \
+      6 * (len)) & 63)
 
-        case '0':
-        case '1':
-        case '2':
-        case '3':
-        case '4':
-        case '5':
-        case '6':
-        case '7':
-        case '8':
-        case '9':   return NUM_TK;
+struct lex_keyword {
+    const char *name;
+    size_t len;
+    enum ash_tk_type type;
+};
 
-        default:    return VAR_TK;
-    }
+static const struct lex_keyword lex_keywords[64] = {
+    [1]  = { "break",  5, BK_TK  },
+    [3]  = { "match",  5, MAT_TK },
+    [4]  = { "while",  5, DO_TK  },
+    [13] = { "to",     2, TO_TK  },
+    [14] = { "for",    3, FOR_TK },
+    [17] = { "or",     2, OR_TK  },
+    [23] = { "until",  5, UT_TK  },
+    [26] = { "let",    3, LET_TK },
+    [31] = { "and",    3, AN_TK  },
+    [32] = { "return", 6, RET_TK },
+    [34] = { "next",   4, NXT_TK },
+    [35] = { "end",    3, END_TK },
+    [39] = { "if",     2, IF_TK  },
+    [40] = { "def",    3, DEF_TK },
+    [43] = { "mod",    3, MOD_TK },
+    [44] = { "else",   4, EL_TK  },
+    [47] = { "elif",   4, ELF_TK },
+    [51] = { "false",  5, FS_TK  },
+    [54] = { "use",    3, USE_TK },
+    [59] = { "true",   4, TR_TK  },
+    [63] = { "in",     2, IN_TK  }
+};
 
-    return NO_TK;
-}
+static enum ash_tk_type lex_token_key_type(const char *string, size_t len)
+{
+    const struct lex_keyword *key;
 
-static enum ash_tk_type lex_token_key_type(const char *s)
-{
-    switch (s[0]) {
-        case 'a':
-            if (s[1] == 'n' &&
-                s[2] == 'd' &&
-                !s[3])
-                return AN_TK;
-            break;
-
-        case 'b':
-            if (s[1] == 'r' &&
-                s[2] == 'e' &&
-                s[3] == 'a' &&
-                s[4] == 'k' &&
-                !s[5])
-                return BK_TK;
-            break;
-
-        case 'd':
-            if (s[1] == 'e' &&
-                s[2] == 'f' &&
-                !s[3])
-                return DEF_TK;
-            break;
-
-        case 'e':
-            if (s[1] == 'l') {
-                if (s[2] == 's' &&
-                    s[3] == 'e' &&
-                    !s[4])
-                    return EL_TK;
-                else if (s[2] == 'i' &&
-                         s[3] == 'f' &&
-                         !s[4])
-                    return ELF_TK;
-            }
-
-            else if (s[1] == 'n' &&
-                s[2] == 'd' &&
-                !s[3])
-                return END_TK;
-            break;
-
-        case 'f':
-            if (s[1] == 'a' &&
-                s[2] == 'l' &&
-                s[3] == 's' &&
-                s[4] == 'e' &&
-                !s[5])
-                return FS_TK;
-            else if (s[1] == 'o' &&
-                     s[2] == 'r' &&
-                     !s[3])
-                 return FOR_TK;
-            break;
-
-        case 'i':
-            if (s[1] == 'f' &&
-                !s[2])
-                return IF_TK;
-            else if (s[1] == 'n' &&
-                     !s[2])
-                 return IN_TK;
-            break;
-
-        case 'l':
-            if (s[1] == 'e' &&
-                s[2] == 't' &&
-                !s[3])
-                return LET_TK;
-            break;
-        case 'm':
-            if (s[1] == 'a' &&
-                s[2] == 't' &&
-                s[3] == 'c' &&
-                s[4] == 'h' &&
-                !s[5])
-                return MAT_TK;
-            else if (s[1] == 'o' &&
-                    s[2] == 'd' &&
-                    !s[3])
-                return MOD_TK;
-            break;
-
-        case 'n':
-            if (s[1] == 'e' &&
-                s[2] == 'x' &&
-                s[3] == 't' &&
-                !s[4])
-                return NXT_TK;
-            break;
-
-        case 'o':
-            if (s[1] == 'r' &&
-                !s[2])
-                return OR_TK;
-            break;
-
-        case 'r':
-            if (s[1] == 'e' &&
-                s[2] == 't' &&
-                s[3] == 'u' &&
-                s[4] == 'r' &&
-                s[5] == 'n' &&
-                !s[6])
-                return RET_TK;
-            break;
-
-        case 't':
-            if (s[1] == 'o' &&
-                !s[2])
-                return TO_TK;
-            else if (s[1] == 'r' &&
-                     s[2] == 'u' &&
-                     s[3] == 'e' &&
-                     !s[4])
-                return TR_TK;
-            break;
-
-        case 'u':
-            if (s[1] == 'n' &&
-                s[2] == 't' &&
-                s[3] == 'i' &&
-                s[4] == 'l' &&
-                !s[5])
-                return UT_TK;
-            else if (s[1] == 's' &&
-                     s[2] == 'e' &&
-                     !s[3])
-                return USE_TK;
-            break;
-
-        case 'w':
-            if (s[1] == 'h' &&
-                s[2] == 'i' &&
-                s[3] == 'l' &&
-                s[4] == 'e' &&
-                !s[5])
-                return DO_TK;
-            break;
-    }
+    if (len < LEX_KEYWORD_MIN || len > LEX_KEYWORD_MAX)
+        return NO_TK;
 
+    key = &lex_keywords[LEX_KEYWORD_HASH(string, len)];
+    if (key->len == len && !memcmp(key->name, string, len))
+        return key->type;
     return NO_TK;
 }
 
+/*
+the input is bounded by its length rather than a terminator, so
+that it may be a view of a mapped file or of another token. token
+strings are in turn views of the input and are never copied here.
+the offset within a line is found from the start of the line, so
+only a newline needs to be tracked as the input is read
+*/
 struct lexer {
-    size_t len;
     bool err;
+    bool expr;
     size_t line;
-    size_t offset;
+    /* characters scanned but left out of the token string */
+    size_t cut;
+    const char *line_start;
     const char *string;
     const char *cursor;
     const char *input;
+    const char *end;
     struct ash_tk_set *set;
 };
 
-static void lexer_init(struct lexer *lexer,
-                       const char *input, struct ash_tk_set *set)
+static void lexer_init(struct lexer *lexer, const char *input,
+                       size_t length, struct ash_tk_set *set)
 {
-    lexer->len = 0;
     lexer->err = false;
+    lexer->expr = false;
     lexer->line = 1;
-    lexer->offset = 1;
+    lexer->cut = 0;
+    lexer->line_start = input;
     lexer->string = NULL;
     lexer->cursor = input;
     lexer->input = input;
+    lexer->end = input + length;
     lexer->set = set;
+
+    if (!set->text) {
+        set->text = input;
+        set->length = length;
+    }
+    /* token offsets are held in 32 bits */
+    if ((size_t) (lexer->end - set->text) > UINT32_MAX)
+        lexer->err = true;
 }
 
 static void lexer_reset(struct lexer *lexer)
 {
-    lexer->len = 0;
+    lexer->cut = 0;
     lexer->string = lexer->cursor;
 }
 
+/* the length of the text scanned since the last reset */
+static inline size_t lexer_len(struct lexer *lexer)
+{
+    return (lexer->cursor - lexer->string) - lexer->cut;
+}
+
+/* the offset of the cursor within the current line */
+static inline size_t lexer_offset(struct lexer *lexer)
+{
+    return (lexer->cursor - lexer->line_start) + 1;
+}
+
 static inline struct ash_tk_set *lexer_token_set(struct lexer *lexer)
 {
     return lexer->set;
@@ -276,22 +210,20 @@ static inline bool lexer_get_error(struct lexer *lexer)
 
 static inline bool lexer_hasnext(struct lexer *lexer)
 {
-    return ((*lexer->cursor) != '\0') ? true: false;
+    return (lexer->cursor < lexer->end) ? true: false;
 }
 
-static char lexer_readnext(struct lexer *lexer)
+static inline char lexer_readnext(struct lexer *lexer)
 {
     char next;
 
-    next = *(lexer->cursor++);
-    if (next)
-        lexer->len++;
+    if (!lexer_hasnext(lexer))
+        return '\0';
 
+    next = *(lexer->cursor++);
     if (next == '\n') {
         lexer->line++;
-        lexer->offset = 1;
-    } else {
-        lexer->offset++;
+        lexer->line_start = lexer->cursor;
     }
 
     return next;
@@ -299,7 +231,14 @@ static char lexer_readnext(struct lexer *lexer)
 
 static inline char lexer_read(struct lexer *lexer)
 {
-    return (*lexer->cursor);
+    return lexer_hasnext(lexer) ? (*lexer->cursor): '\0';
+}
+
+/* the character `n` places beyond the cursor */
+static inline char lexer_peek(struct lexer *lexer, size_t n)
+{
+    return (n < (size_t)(lexer->end - lexer->cursor)) ?
+        lexer->cursor[n]: '\0';
 }
 
 static inline bool lexer_assert_next(struct lexer *lexer, char c)
@@ -311,64 +250,93 @@ static inline bool lexer_assert_next(struct lexer *lexer, char c)
     return false;
 }
 
+/* move the cursor forward to `to`, counting the lines passed */
+static inline void lexer_skip(struct lexer *lexer, const char *to)
+{
+    const char *nl = lexer->cursor;
+
+    while ((nl = memchr(nl, '\n', to - nl))) {
+        lexer->line++;
+        lexer->line_start = ++nl;
+    }
+    lexer->cursor = to;
+}
+
+/* move the cursor past a run of characters that do not end a word */
+static inline void lexer_skip_word(struct lexer *lexer)
+{
+    const char *p = lexer->cursor;
+
+    while (p < lexer->end && !lex_word_end[(unsigned char) *p])
+        ++p;
+    lexer->cursor = p;
+}
+
+static inline void lexer_skip_ws(struct lexer *lexer)
+{
+    const char *p = lexer->cursor;
+
+    while (p < lexer->end && lex_is_ws(*p))
+        ++p;
+    lexer->cursor = p;
+}
+
 static inline void lexer_token_add_string(struct lexer *lexer,
                                           enum ash_tk_type type,
-                                          const char *string)
+                                          const char *string, size_t len)
 {
-    size_t offset;
+    const char *at;
+    uint8_t flags = 0;
     struct ash_tk_set *set;
-    struct ash_tk_meta meta;
 
-    offset = (lexer->offset - lexer->len);
     set = lexer_token_set(lexer);
-    ash_tk_meta_init(&meta, lexer->line, offset);
+    at = lexer->string;
+    if (string) {
+        at = string;
+        flags = ASH_TK_STR;
+    }
 
-    ash_tk_set_add(set, type, string, &meta);
+    ash_tk_set_add(set, type, flags, lexer->line, at - set->text, len);
 }
 
 static inline void lexer_token_add(struct lexer *lexer, enum ash_tk_type type)
 {
-    lexer_token_add_string(lexer, type, NULL);
+    lexer_token_add_string(lexer, type, NULL, 0);
 }
 
-static inline bool lexer_find_char(struct lexer *lexer, char c)
+/* add a token whose string is the text scanned since the last reset */
+static inline void lexer_token_add_view(struct lexer *lexer,
+                                        enum ash_tk_type type)
 {
-    do {
-        if ((c == lexer_read(lexer)))
-            return true;
-    } while (lexer_readnext(lexer));
-
-    return false;
+    lexer_token_add_string(lexer, type, lexer->string, lexer_len(lexer));
 }
 
-static const char *lexer_get_string(struct lexer *lexer)
+/* move the cursor to the next `c`, or to the end of the input */
+static inline bool lexer_find_char(struct lexer *lexer, char c)
 {
-    char *s;
-    size_t len;
+    const char *at;
 
-    len = lexer->len;
-    assert((len + 1) > 0);
-    s = ash_zalloc((len + 1));
-    memcpy(s, lexer->string, len);
-    return s;
+    if ((at = memchr(lexer->cursor, c, lexer->end - lexer->cursor))) {
+        lexer_skip(lexer, at);
+        return true;
+    }
+
+    lexer_skip(lexer, lexer->end);
+    return false;
 }
 
-static const char *lexer_get_qstring(struct lexer *lexer)
+/* narrow the scanned text to the contents of a quoted string */
+static bool lexer_get_qstring(struct lexer *lexer)
 {
     if (!lexer_find_char(lexer, '"')) {
         lexer->err = true;
-        return NULL;
+        return false;
     }
     lexer_readnext(lexer);
 
     lexer->string++;
-    lexer->len -= 2;
-    return lexer_get_string(lexer);
-}
-
-static inline const char *lexer_get_cursor(struct lexer *lexer)
-{
-    return lexer->cursor;
+    lexer->cut = 1;
+    return true;
 }
 
 static void lexer_skip_comment(struct lexer *lexer)
@@ -388,34 +356,92 @@ static inline bool lex_is_expr_type(enum ash_tk_type type)
 
 static void lex_symbol_var(struct lexer *lexer, enum ash_tk_type type)
 {
-    enum ash_tk_type next;
-    const char *string;
-
-    for (;;) {
-        next = lex_token_type(lexer_read(lexer));
-        if (!(next == VAR_TK || next == NUM_TK || next == EQ_TK))
-            break;
-        lexer_readnext(lexer);
-    }
+    lexer_skip_word(lexer);
 
     if (type == AV_TK)
-        return lexer_token_add_string(lexer, AV_TK, lexer_get_string(lexer));
+        return lexer_token_add_view(lexer, AV_TK);
 
-    string = lexer_get_string(lexer);
-    type = lex_token_key_type(string);
+    type = lex_token_key_type(lexer->string, lexer_len(lexer));
 
     if (type == NO_TK)
-        return lexer_token_add_string(lexer, VAR_TK, string);
-    ash_free((char *) string);
+        return lexer_token_add_view(lexer, VAR_TK);
     lexer_token_add(lexer, type);
 }
 
-static void lex_symbol_default(struct lexer *lexer, enum ash_tk_type type)
+/*
+scan a redirection operator following an optional descriptor
+number `fd`, which becomes the string of the token
+*/
+static void lex_symbol_redirect(struct lexer *lexer, char c,
+                                const char *fd, size_t len)
+{
+    enum ash_tk_type type;
+
+    if (c == '>') {
+        if (lexer_assert_next(lexer, '>'))
+            type = RDA_TK;
+        else if (lexer_assert_next(lexer, '&'))
+            type = RDD_TK;
+        else
+            type = RDO_TK;
+    } else {
+        type = RDI_TK;
+        if (lexer_read(lexer) == '<' &&
+            lexer_peek(lexer, 1) == '<') {
+            lexer_readnext(lexer);
+            lexer_readnext(lexer);
+            type = RDS_TK;
+        }
+    }
+
+    lexer_token_add_string(lexer, type, fd, len);
+}
+
+/* scan the body of a command substitution up to its closing paren */
+static void lex_symbol_subst(struct lexer *lexer, enum ash_tk_type type)
 {
-    if (type == WS_TK || type == NO_TK)
+    char c;
+    size_t depth = 1;
+
+    /* opening paren */
+    lexer_readnext(lexer);
+    lexer_reset(lexer);
+
+    while ((c = lexer_readnext(lexer))) {
+        if (c == '"') {
+            if (!lexer_find_char(lexer, '"'))
+                break;
+            lexer_readnext(lexer);
+        } else if (c == '#') {
+            if (!lexer_find_char(lexer, '\n'))
+                break;
+        } else if (c == '(') {
+            depth++;
+        } else if (c == ')' && --depth == 0) {
+            lexer->cut = 1;
+            lexer_token_add_view(lexer, type);
             return;
+        }
+    }
+
+    lexer->err = true;
+}
+
+static void lex_symbol_default(struct lexer *lexer, enum ash_tk_type type)
+{
+    if (type == WS_TK)
+        lexer_skip_ws(lexer);
+    else if (type == NO_TK)
+        return;
     else if (type == CM_TK)
         lexer_skip_comment(lexer);
+    else if (type == AV_TK && lexer_read(lexer) == '(')
+        lex_symbol_subst(lexer, CS_TK);
+    else if (type == AV_TK && lexer_read(lexer) == '<' &&
+             lexer_peek(lexer, 1) == '(') {
+        lexer_readnext(lexer);
+        lex_symbol_subst(lexer, CSL_TK);
+    }
     else if (type == AV_TK || type == VAR_TK)
         lex_symbol_var(lexer, type);
     else if (type == EQ_TK) {
@@ -434,17 +460,25 @@ static void lex_symbol_default(struct lexer *lexer, enum ash_tk_type type)
             type = SCP_TK;
         lexer_token_add(lexer, type);
     }
+    else if (type == LN_TK || type == GN_TK) {
+        lex_symbol_redirect(lexer, (type == LN_TK) ? '<': '>', NULL, 0);
+    }
     else if (type == NUM_TK) {
         while (lex_is_numeric(lexer_read(lexer)))
             lexer_readnext(lexer);
+        char c = lexer_read(lexer);
+        if (!lexer->expr && (c == '<' || c == '>')) {
+            size_t len = lexer_len(lexer);
+            lexer_readnext(lexer);
+            return lex_symbol_redirect(lexer, c, lexer->string, len);
+        }
         if (lex_token_type(lexer_read(lexer)) == VAR_TK)
             return lex_symbol_var(lexer, VAR_TK);
-        lexer_token_add_string(lexer, NUM_TK, lexer_get_string(lexer));
+        lexer_token_add_view(lexer, NUM_TK);
     }
     else if (type == DQT_TK) {
-        const char *string;
-        if ((string = lexer_get_qstring(lexer)))
-            lexer_token_add_string(lexer, type, string);
+        if (lexer_get_qstring(lexer))
+            lexer_token_add_view(lexer, type);
     } else
         lexer_token_add(lexer, type);
 }
@@ -461,6 +495,7 @@ static void lex_symbol_expr(struct lexer *lexer, char exit)
 {
     char c;
     exit = lex_expr_exit(exit);
+    lexer->expr = true;
 
     do {
         lexer_reset(lexer);
@@ -468,6 +503,7 @@ static void lex_symbol_expr(struct lexer *lexer, char exit)
 
         if (c == exit) {
             lexer_token_add(lexer, lex_token_type(exit));
+            lexer->expr = false;
             return;
         }
         else if (c == '[')
@@ -510,37 +546,90 @@ static void lex_symbol_expr(struct lexer *lexer, char exit)
             lex_symbol_default(lexer, lex_token_type(c));
 
     } while (lexer_hasnext(lexer));
+
+    lexer->expr = false;
 }
 
-static int lex_main(struct lexer *lexer)
+static int lex_main_next(struct lexer *lexer)
 {
     char c;
     enum ash_tk_type type;
 
-    while (lexer_hasnext(lexer)) {
-        lexer_reset(lexer);
-        c = lexer_readnext(lexer);
-        type = lex_token_type(c);
+    lexer_reset(lexer);
+    c = lexer_readnext(lexer);
+    type = lex_token_type(c);
 
-        if (lex_is_expr_type(type)) {
-            lexer_token_add(lexer, type);
-            lex_symbol_expr(lexer, c);
-        } else {
-            lex_symbol_default(lexer, type);
-        }
+    if (lex_is_expr_type(type)) {
+        lexer_token_add(lexer, type);
+        lex_symbol_expr(lexer, c);
+    } else {
+        lex_symbol_default(lexer, type);
+    }
+
+    if (lexer_get_error(lexer))
+        return -1;
+    return 0;
+}
 
-        if (lexer_get_error(lexer))
+static int lex_main(struct lexer *lexer)
+{
+    while (lexer_hasnext(lexer)) {
+        if (lex_main_next(lexer))
             return -1;
     }
 
     return 0;
 }
 
-int lex_scan_input(struct ash_tk_set *set, const char *input)
+int lex_scan_input(struct ash_tk_set *set, const char *input, size_t length)
 {
     struct lexer lexer;
-    lexer_init(&lexer, input, set);
-    if (lex_main(&lexer))
+    lexer_init(&lexer, input, length, set);
+    if (lexer_get_error(&lexer) || lex_main(&lexer))
+        return -1;
+    return 0;
+}
+
+/*
+a stream scans its input on demand, so that the parser
+may consume the front of a script before the rest of it
+has been read
+*/
+struct lexer *lex_stream_new(struct ash_tk_set *set,
+                             const char *input, size_t length)
+{
+    struct lexer *lexer;
+    lexer = ash_alloc(sizeof *lexer);
+    lexer_init(lexer, input, length, set);
+    set->lexer = lexer;
+    return lexer;
+}
+
+/*
+scan until at least one more token has been added to the set;
+returns 1 when it has, 0 at the end of the input and -1 on error
+*/
+int lex_stream_next(struct lexer *lexer)
+{
+    size_t end;
+
+    if (lexer_get_error(lexer))
         return -1;
+
+    end = ash_tk_set_end(lexer->set);
+    while (lexer_hasnext(lexer)) {
+        if (lex_main_next(lexer))
+            return -1;
+        if (ash_tk_set_end(lexer->set) != end)
+            return 1;
+    }
+
     return 0;
 }
+
+void lex_stream_destroy(struct lexer *lexer)
+{
+    if (lexer->set->lexer == lexer)
+        lexer->set->lexer = NULL;
+    ash_free(lexer);
+}
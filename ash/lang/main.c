@@ -14,39 +14,48 @@
    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <stdlib.h>
+
 #include "ash/env.h"
 #include "ash/io.h"
+#include "ash/mem.h"
 #include "ash/lang/ast.h"
+#include "ash/lang/cache.h"
 #include "ash/lang/lang.h"
 #include "ash/lang/lex.h"
 #include "ash/lang/main.h"
 #include "ash/lang/parser.h"
 #include "ash/lang/runtime.h"
 
+#ifdef ASH_PLATFORM_POSIX
+    #include <unistd.h>
+#endif
+
 static int ash_main_scan(struct input *input, struct ash_tk_set *set)
 {
     const char *content;
     if (!(content = input_text_content(input)))
         return -1;
 
-    if (lex_scan_input(set, content))
+    if (lex_scan_input(set, content, input_text_length(input)))
         return -1;
     return 0;
 }
 
 static int ash_main_parse(struct input *input, struct ast_prog *prog)
 {
+    int status = -1;
     struct ash_tk_set set;
-    ash_tk_set_init(&set);
-    if (ash_main_scan(input, &set))
-        return -1;
+    struct parser_meta meta;
 
-    if (ash_tk_set_empty(&set))
-        return -1;
+    ash_tk_set_init(&set);
+    if (ash_main_scan(input, &set) == 0 && !ash_tk_set_empty(&set)) {
+        parser_meta_init(&meta, input, &set);
+        status = parser_ast_construct(prog, &meta);
+    }
 
-    struct parser_meta meta;
-    parser_meta_init(&meta, input, &set);
-    return parser_ast_construct(prog, &meta);
+    ash_tk_set_destroy(&set);
+    return status;
 }
 
 static inline
@@ -54,10 +63,302 @@ void ash_main_prompt(struct input *input)
 {
     const char *text;
 
-    if ((text = ash_scan("$ ")))
+    if ((text = ash_scan(ash_prompt())))
         input_text_init(input, text);
 }
 
+/*
+the statements of a script parsed ahead of being run, so that
+a batch of scripts may be parsed together and run in order
+*/
+struct ash_main_parsed {
+    struct ast_stm **stm;
+    bool *retain;
+    size_t count;
+    size_t size;
+};
+
+static struct ash_main_parsed *ash_main_parsed_new(void)
+{
+    struct ash_main_parsed *parsed;
+    parsed = ash_alloc(sizeof *parsed);
+    parsed->size = 16;
+    parsed->count = 0;
+    parsed->stm = ash_alloc((sizeof *parsed->stm) * parsed->size);
+    parsed->retain = ash_alloc((sizeof *parsed->retain) * parsed->size);
+    return parsed;
+}
+
+static void ash_main_parsed_add(struct ash_main_parsed *parsed,
+                                struct ast_stm *stm, bool retain)
+{
+    if (parsed->count == parsed->size) {
+        parsed->size *= 2;
+        parsed->stm = ash_realloc(parsed->stm,
+            (sizeof *parsed->stm) * parsed->size);
+        parsed->retain = ash_realloc(parsed->retain,
+            (sizeof *parsed->retain) * parsed->size);
+    }
+    parsed->stm[parsed->count] = stm;
+    parsed->retain[parsed->count] = retain;
+    parsed->count++;
+}
+
+static void ash_main_parsed_free(struct ash_main_parsed *parsed)
+{
+    ash_free(parsed->stm);
+    ash_free(parsed->retain);
+    ash_free(parsed);
+}
+
+void ash_main_parsed_destroy(struct ash_main_parsed *parsed)
+{
+    for (size_t i = 0; i < parsed->count; ++i)
+        ast_stm_destroy(parsed->stm[i]);
+    ash_main_parsed_free(parsed);
+}
+
+/*
+parse the whole of a script into `parsed` without running it,
+writing it to its cache as well when it can be
+*/
+static int ash_main_cache(struct input *input, struct ash_main_parsed *parsed)
+{
+    int status;
+    bool retain;
+    struct cache_writer *writer;
+    struct lexer *lexer;
+    struct parser *parser;
+    struct ast_stm *stm;
+    struct ash_tk_set set;
+    struct parser_meta meta;
+
+    writer = cache_writer_new(input->method.script);
+    ash_tk_set_init(&set);
+    lexer = lex_stream_new(&set, input_text_content(input),
+                           input_text_length(input));
+    parser_meta_init(&meta, input, &set);
+    meta.quiet = true;
+    parser = parser_new(&meta);
+
+    while ((status = parser_ast_next(parser, &stm, &retain)) > 0) {
+        if (writer)
+            cache_writer_add(writer, stm, retain);
+        ash_main_parsed_add(parsed, stm, retain);
+    }
+
+    if (writer) {
+        /* the statements kept are good without their cache */
+        if (status == 0)
+            cache_writer_commit(writer);
+        cache_writer_destroy(writer);
+    }
+    parser_destroy(parser);
+    lex_stream_destroy(lexer);
+    ash_tk_set_destroy(&set);
+    return status;
+}
+
+/*
+read the statements of a script from its cache, or else scan
+and parse it, without running any of it. nothing is printed
+and no runtime state is used, so it is safe to call from any
+thread. returns NULL if the script does not parse, it is then
+left to be run as it streams so its error is reported there
+*/
+struct ash_main_parsed *ash_main_parse_ahead(struct input *input)
+{
+    int status;
+    bool retain;
+    struct cache *cache;
+    struct ast_stm *stm;
+    struct ash_main_parsed *parsed;
+
+    if (!input_text_content(input))
+        return NULL;
+
+    parsed = ash_main_parsed_new();
+    if ((cache = cache_load(input->method.script))) {
+        while ((status = cache_next(cache, &stm, &retain)) > 0)
+            ash_main_parsed_add(parsed, stm, retain);
+        cache_close(cache);
+    } else
+        status = ash_main_cache(input, parsed);
+
+    if (status != 0) {
+        ash_main_parsed_destroy(parsed);
+        return NULL;
+    }
+    return parsed;
+}
+
+/* run the statements of a script parsed ahead, then free them */
+int ash_main_parsed_exec(struct ash_main_parsed *parsed)
+{
+    struct ast_prog prog;
+    struct ash_runtime runtime;
+    struct ash_runtime_env renv;
+    struct ash_runtime_prog rprog;
+
+    runtime_init(&runtime, RUNTIME_ID_DEFAULT);
+    runtime_env_rt_init(&renv, &runtime, NULL, NULL);
+
+    for (size_t i = 0; i < parsed->count; ++i) {
+        ast_prog_init(&prog, parsed->stm[i]);
+        runtime_prog_init(&rprog, prog, renv);
+        runtime_exec(&rprog);
+        if (!parsed->retain[i])
+            ast_stm_destroy(parsed->stm[i]);
+    }
+
+    ash_main_parsed_free(parsed);
+    return 0;
+}
+
+/* run the statements of a script as they were last parsed */
+static int ash_main_cached(struct cache *cache, struct ash_runtime_env renv)
+{
+    int status;
+    bool retain;
+    struct ast_stm *stm;
+    struct ast_prog prog;
+    struct ash_runtime_prog rprog;
+
+    while ((status = cache_next(cache, &stm, &retain)) > 0) {
+        ast_prog_init(&prog, stm);
+        runtime_prog_init(&rprog, prog, renv);
+        runtime_exec(&rprog);
+        if (!retain)
+            ast_stm_destroy(stm);
+    }
+
+    cache_close(cache);
+    return status;
+}
+
+/*
+a script being streamed into its cache; one that exits before
+its end has the rest of it parsed into the cache at exit
+*/
+struct ash_main_writer {
+    struct cache_writer *writer;
+    struct parser *parser;
+    pid_t pid;
+    struct ash_main_writer *prev;
+};
+
+static struct ash_main_writer *writing = NULL;
+
+/* parse the rest of the script into the cache and commit it */
+static void ash_main_writer_finish(struct ash_main_writer *w)
+{
+    int status;
+    bool retain;
+    struct ast_stm *stm;
+
+    while ((status = parser_ast_next(w->parser, &stm, &retain)) > 0) {
+        cache_writer_add(w->writer, stm, retain);
+        ast_stm_destroy(stm);
+    }
+    if (status == 0)
+        cache_writer_commit(w->writer);
+}
+
+static void ash_main_writer_exit(void)
+{
+    struct ash_main_writer *w;
+
+    for (w = writing; w; w = w->prev) {
+        /* a child leaves the cache to the shell that is writing it */
+        if (w->pid != getpid())
+            continue;
+        parser_quiet(w->parser);
+        ash_main_writer_finish(w);
+        cache_writer_destroy(w->writer);
+    }
+    writing = NULL;
+}
+
+static void ash_main_writer_push(struct ash_main_writer *w,
+                                 struct cache_writer *writer,
+                                 struct parser *parser)
+{
+    static bool registered = false;
+
+    w->writer = writer;
+    w->parser = parser;
+    w->pid = getpid();
+    w->prev = writing;
+    writing = w;
+
+    if (!registered) {
+        registered = true;
+        atexit(ash_main_writer_exit);
+    }
+}
+
+/*
+scripts are scanned, parsed and run a top-level statement
+at a time, so that neither the tokens nor the ast of the
+whole script are held at once. a statement is kept only
+when it defines something the runtime still refers to.
+each statement is written to the cache of the script as it
+runs, so that a script that parses is run from its cache
+instead and not scanned or parsed again until it changes
+*/
+static int ash_main_stream(struct input *input, struct ash_runtime_env renv)
+{
+    int status;
+    bool retain;
+    const char *content;
+    struct cache *cache;
+    struct cache_writer *writer;
+    struct ash_main_writer w;
+    struct lexer *lexer;
+    struct parser *parser;
+    struct ast_stm *stm;
+    struct ast_prog prog;
+    struct ash_runtime_prog rprog;
+    struct ash_tk_set set;
+    struct parser_meta meta;
+
+    if (!(content = input_text_content(input)))
+        return -1;
+
+    if ((cache = cache_load(input->method.script)))
+        return ash_main_cached(cache, renv);
+
+    ash_tk_set_init(&set);
+    lexer = lex_stream_new(&set, content, input_text_length(input));
+    parser_meta_init(&meta, input, &set);
+    parser = parser_new(&meta);
+
+    if ((writer = cache_writer_new(input->method.script)))
+        ash_main_writer_push(&w, writer, parser);
+
+    while ((status = parser_ast_next(parser, &stm, &retain)) > 0) {
+        if (writer)
+            cache_writer_add(writer, stm, retain);
+        ast_prog_init(&prog, stm);
+        runtime_prog_init(&rprog, prog, renv);
+        runtime_exec(&rprog);
+        if (!retain)
+            ast_stm_destroy(stm);
+    }
+
+    if (writer) {
+        writing = w.prev;
+        if (status == 0)
+            cache_writer_commit(writer);
+        cache_writer_destroy(writer);
+    }
+
+    parser_destroy(parser);
+    lex_stream_destroy(lexer);
+    ash_tk_set_destroy(&set);
+    return status;
+}
+
 int ash_main_input(struct input *input)
 {
     struct ast_prog prog;
@@ -67,6 +368,8 @@ int ash_main_input(struct input *input)
 
     runtime_init(&runtime, RUNTIME_ID_DEFAULT);
     runtime_env_rt_init(&renv, &runtime, NULL, NULL);
+    if (input->type == ASH_INPUT_SCRIPT)
+        return ash_main_stream(input, renv);
     if (ash_main_parse(input, &prog))
         return -1;
     runtime_prog_init(&rprog, prog, renv);
@@ -15,21 +15,29 @@
 */
 
 #include "ash/io.h"
+#include "ash/mem.h"
 #include "ash/lang/ast.h"
 #include "ash/lang/lang.h"
+#include "ash/lang/lex.h"
 #include "ash/lang/parser.h"
 
 struct parser {
     struct ash_tk_set *set;
-    struct ash_tk *token;
+    /* the index of the current token within the set */
+    size_t token;
     const char *source;
+    /* where the current token was found, for reporting errors */
     size_t line;
     size_t offset;
+    struct ash_tk_set *origin;
     bool error;
     bool interactive;
+    bool quiet;
     size_t block;
     size_t fblock;
     size_t lblock;
+    /* definitions the runtime may refer to after a statement has run */
+    size_t retain;
     struct ast_path *path;
 };
 
@@ -38,23 +46,27 @@ static void parser_init(struct parser *p, struct parser_meta *meta)
     const char *source;
     struct ash_tk *token;
     source = input_get_name(meta->input);
-    token = ash_tk_set_front(meta->set);
+    token = ash_tk_set_get(meta->set, meta->set->base);
 
     p->set = meta->set;
-    p->token = token;
+    p->token = meta->set->base;
     p->source = source;
     p->line = (token) ? token->line: 1;
-    p->offset = (token) ? token->offset: 1;
+    p->offset = (token) ? token->offset: 0;
+    p->origin = meta->set;
     p->error = false;
     p->interactive = (meta->input->interactive) ? true: false;
+    p->quiet = meta->quiet;
     p->block = 0;
     p->fblock = 0;
     p->lblock = 0;
+    p->retain = 0;
     p->path = NULL;
 }
 
 static struct ast_stm *parser_main(struct parser *);
 static struct ast_stm *parser_stm(struct parser *);
+static struct ast_stm *parser_function_main(struct parser *);
 static struct ast_call *parser_call(struct parser *);
 static struct ast_return *parser_return(struct parser *);
 static struct ast_expr *parser_path_expr(struct parser *);
@@ -106,16 +118,22 @@ parser_set_path(struct parser *p, struct ast_path *path)
     p->path = path;
 }
 
+/*
+a token is only valid until the next is scanned, which may
+move the tokens of the set
+*/
 static inline struct ash_tk *
 parser_get_token(struct parser *p)
 {
-    return p->token;
+    return ash_tk_set_get(p->set, p->token);
 }
 
 static inline enum ash_tk_type
 parser_get_type(struct parser *p)
 {
-    return ash_tk_get(&p->token);
+    struct ash_tk *token;
+    token = parser_get_token(p);
+    return (token) ? token->type: NO_TK;
 }
 
 static inline void
@@ -180,13 +198,45 @@ static inline bool parser_block_eq(struct parser *p, size_t block)
     return (block == p->block);
 }
 
+static inline void
+parser_retain(struct parser *p)
+{
+    p->retain++;
+}
+
+/*
+when the tokens are streamed, scan ahead of the current
+token so that its successor and end of statement are known
+*/
+static void
+parser_fill(struct parser *p)
+{
+    int status;
+
+    if (!(p->set->lexer && parser_get_token(p)))
+        return;
+
+    while (p->token + 1 >= ash_tk_set_end(p->set)) {
+        if ((status = lex_stream_next(p->set->lexer)) <= 0) {
+            if (status < 0)
+                p->error = true;
+            break;
+        }
+    }
+}
+
 static inline struct ash_tk *
 parser_get_next(struct parser *p)
 {
     struct ash_tk *token;
-    if ((token = ash_tk_next(&p->token))) {
+    parser_fill(p);
+    if (!parser_get_token(p))
+        return NULL;
+
+    if ((token = ash_tk_set_get(p->set, ++p->token))) {
         p->line = token->line;
         p->offset = token->offset;
+        p->origin = p->set;
     }
     return token;
 }
@@ -201,19 +251,31 @@ parser_get_next_type(struct parser *p)
 static inline enum ash_tk_type
 parser_check_next(struct parser *p)
 {
-    return ash_tk_cknext(&p->token);
+    struct ash_tk *token;
+    parser_fill(p);
+    if (!parser_get_token(p))
+        return NO_TK;
+    token = ash_tk_set_get(p->set, p->token + 1);
+    return (token) ? token->type: NO_TK;
 }
 
 static inline bool
 parser_check_end(struct parser *p)
 {
-    return ash_tk_eos(&p->token);
+    struct ash_tk *token;
+    parser_fill(p);
+    token = parser_get_token(p);
+    return (token && (token->flags & ASH_TK_EOS)) ? true: false;
 }
 
 static inline bool
 parser_end_of_statement(struct parser *p)
 {
-    return ash_tk_get_eos(&p->token);
+    if (parser_check_next(p) == SEM_TK) {
+        p->token++;
+        return true;
+    }
+    return parser_check_end(p);
 }
 
 static inline bool
@@ -224,7 +286,7 @@ parser_has_error(struct parser *p)
 
 static inline int parser_assert(struct parser *p, enum ash_tk_type type)
 {
-    int assert = ash_tk_assert_type(&p->token, type);
+    int assert = (parser_get_type(p) != type) ? -1: 0;
     if (assert)
         parser_error_expec(p, type);
     return assert;
@@ -240,9 +302,9 @@ static void parser_error_msg(struct parser *p, const char *fmt, const char *msg)
 {
     const char *src = parser_get_source(p);
     size_t line = p->line;
-    size_t offset = p->offset;
+    size_t offset = ash_tk_set_column(p->origin, p->offset);
     p->error = true;
-    if (msg)
+    if (msg && !p->quiet)
         ash_print(fmt, src, line, offset, msg);
 }
 
@@ -281,12 +343,18 @@ static void parser_error_found_current(struct parser *p)
 
 static inline const char *parser_get_str(struct parser *p)
 {
-    return ash_tk_strcpy(&p->token);
+    const char *str;
+    struct ash_tk *token;
+
+    token = parser_get_token(p);
+    if (!(token && (str = ash_tk_set_str(p->set, token))))
+        return NULL;
+    return ast_strdup(str, token->len);
 }
 
 static inline isize parser_get_num(struct parser *p)
 {
-    return ash_tk_num(&p->token);
+    return ash_tk_set_num(p->set, parser_get_token(p));
 }
 
 static isize parser_value_num(struct parser *p)
@@ -433,6 +501,7 @@ static struct ast_function *parser_closure(struct parser *p)
     struct ast_stm *stm = NULL;
 
     parser_assert(p, PIP_TK);
+    parser_retain(p);
 
     if (parser_get_next_type(p) != PIP_TK)
         param = parser_param(p);
@@ -519,6 +588,62 @@ static struct ast_literal *parser_literal(struct parser *p)
     return literal;
 }
 
+static struct ast_subst *parser_subst(struct parser *p)
+{
+    size_t line;
+    const char *str;
+    struct ash_tk *token;
+    struct ash_tk_set set;
+    struct parser parser;
+    struct ast_stm *stm = NULL, *next = NULL;
+    enum ast_subst_type type;
+
+    token = parser_get_token(p);
+    type = (token->type == CSL_TK) ? AST_SUBST_LINES: AST_SUBST_STRING;
+    line = token->line;
+
+    ash_tk_set_init(&set);
+    if ((str = ash_tk_set_str(p->set, token)) &&
+        lex_scan_input(&set, str, token->len)) {
+        ash_tk_set_destroy(&set);
+        parser_error_expec_msg(p, "')'");
+        return NULL;
+    }
+
+    /* the body is parsed as a program of its own */
+    parser = *p;
+    parser.set = &set;
+    parser.token = 0;
+    parser.interactive = false;
+    parser.block = parser.fblock = parser.lblock = 0;
+    parser.path = NULL;
+
+    for (size_t i = 0; i < set.count; ++i)
+        set.tokens[i].line += line - 1;
+
+    if (!ash_tk_set_empty(&set)) {
+        do {
+            if (next) {
+                next->next = parser_function_main(&parser);
+                next = next->next;
+            } else if (!stm) {
+                stm = parser_function_main(&parser);
+                next = stm;
+            }
+        } while (!parser_has_error(&parser) && parser_get_next(&parser));
+    }
+
+    p->retain = parser.retain;
+    ash_tk_set_destroy(&set);
+    if (parser_has_error(&parser)) {
+        /* the partial body is in the statement's pool, released with it */
+        p->error = true;
+        return NULL;
+    }
+
+    return ast_subst_new(type, stm);
+}
+
 static struct ast_value *parser_value(struct parser *p)
 {
     struct ast_value *value = NULL;
@@ -846,6 +971,10 @@ static struct ast_expr *parser_expr(struct parser *p)
             expr = ast_expr_new(AST_EXPR_CALL, call);
     } else if (parser_is_scope(p, type)) {
         expr = parser_path_expr(p);
+    } else if (type == CS_TK || type == CSL_TK) {
+        struct ast_subst *subst;
+        if ((subst = parser_subst(p)))
+            expr = ast_expr_new(AST_EXPR_SUBST, subst);
     } else {
         struct ast_value *value;
         if ((value = parser_value(p)))
@@ -1085,8 +1214,9 @@ static inline bool parser_is_otherwise(struct parser *p)
     if (parser_get_type(p) != VAR_TK)
         return false;
 
-    const char *s = parser_get_str(p);
-    return (s && s[0] == '_' && !s[1]) ? true: false;
+    struct ash_tk *token = parser_get_token(p);
+    const char *str = ash_tk_set_str(p->set, token);
+    return (token->len == 1 && str[0] == '_') ? true: false;
 }
 
 static struct ast_case *parser_case(struct parser *p)
@@ -1156,15 +1286,85 @@ static struct ast_match *parser_match(struct parser *p)
     return match;
 }
 
+static inline bool parser_is_redirect(enum ash_tk_type type)
+{
+    return (type == RDO_TK || type == RDA_TK ||
+            type == RDI_TK || type == RDD_TK ||
+            type == RDS_TK);
+}
+
+static struct ast_io *parser_redirect(struct parser *p)
+{
+    enum ash_exec_redirect rtype;
+    struct ast_expr *expr;
+    int fd;
+
+    switch (parser_get_type(p)) {
+        case RDO_TK:
+            rtype = ASH_REDIRECTION;
+            fd = 1;
+            break;
+        case RDA_TK:
+            rtype = ASH_APPEND;
+            fd = 1;
+            break;
+        case RDD_TK:
+            rtype = ASH_DUPLICATION;
+            fd = 1;
+            break;
+        case RDI_TK:
+            rtype = ASH_INDIRECTION;
+            fd = 0;
+            break;
+        case RDS_TK:
+            rtype = ASH_HERESTRING;
+            fd = 0;
+            break;
+        default:
+            parser_error_found_current(p);
+            return NULL;
+    }
+
+    if (parser_get_token(p)->flags & ASH_TK_STR)
+        fd = parser_get_num(p);
+
+    if (!parser_get_next(p)) {
+        parser_error_expec_msg(p, "<redirection target>");
+        return NULL;
+    }
+
+    if (!(expr = parser_expr_main(p)))
+        return NULL;
+    return ast_io_new(rtype, fd, expr);
+}
+
 static struct ast_command *parser_command(struct parser *p)
 {
     enum ash_tk_type type;
     struct ast_command *command = NULL;
     struct ast_expr *expr = NULL, *next = NULL;
+    struct ast_command *pipe = NULL;
+    struct ast_io *io = NULL, *nio = NULL;
     size_t length = 0;
 
     for (;;) {
-        if (next) {
+        if (expr && parser_get_type(p) == PIP_TK) {
+            /* the rest of the statement is the next pipeline stage */
+            if (parser_check_end(p))
+                parser_assert_prompt(p, INPUT_PROMPT_COMMAND);
+            if (!parser_get_next(p)) {
+                parser_error_expec_msg(p, "<command> following '|'");
+                return NULL;
+            }
+            if (!(pipe = parser_command(p)))
+                return NULL;
+            break;
+        } else if (expr && parser_is_redirect(parser_get_type(p))) {
+            if (nio)
+                nio = nio->next = parser_redirect(p);
+            else
+                io = nio = parser_redirect(p);
+        } else if (next) {
             next->next = parser_expr_main(p);
             if ((next = next->next))
                 length++;
@@ -1201,7 +1401,9 @@ static struct ast_command *parser_command(struct parser *p)
         }
     }
 
-    command = ast_command_new(expr, length);
+    command = ast_command_new(expr, length, io);
+    if (pipe)
+        ast_command_pipe(command, pipe);
     return command;
 }
 
@@ -1270,6 +1472,7 @@ static struct ast_stm *parser_stm(struct parser *p)
     type = parser_get_type(p);
     void *node = NULL;
     struct ast_stm *stm = NULL;
+    size_t line = p->line;
 
     switch (type) {
 
@@ -1307,6 +1510,8 @@ static struct ast_stm *parser_stm(struct parser *p)
             break;
 
         case BQ_TK:
+        case CS_TK:
+        case CSL_TK:
         case DQT_TK:
         case NUM_TK:
         case QMK_TK:
@@ -1369,13 +1574,11 @@ static struct ast_stm *parser_stm(struct parser *p)
     }
 
     if (!parser_has_error(p) && ntype != NO_TK)
-        stm = ast_stm_new(ntype, node);
+        stm = ast_stm_new(ntype, node, line);
 
     return stm;
 }
 
-static struct ast_stm *parser_function_main(struct parser *);
-
 static struct ast_stm *parser_function_block(struct parser *p)
 {
     enum ash_tk_type type;
@@ -1409,6 +1612,7 @@ static struct ast_function *parser_function(struct parser *p)
     const char *id;
 
     parser_assert(p, DEF_TK);
+    parser_retain(p);
     parser_fblock_inc(p);
     parser_assert_next(p, VAR_TK);
     id = parser_get_str(p);
@@ -1458,11 +1662,12 @@ static struct ast_return *parser_return(struct parser *p)
 static struct ast_stm *parser_function_main(struct parser *p)
 {
     struct ast_stm *stm = NULL;
+    size_t line = p->line;
 
     if (parser_get_type(p) == DEF_TK) {
         void *node;
         if ((node = parser_function(p)))
-            stm = ast_stm_new(AST_NODE_FUNC, node);
+            stm = ast_stm_new(AST_NODE_FUNC, node, line);
     } else
         stm = parser_stm(p);
 
@@ -1591,6 +1796,7 @@ static struct ast_module *parser_module(struct parser *p)
     const char *name;
 
     parser_assert(p, MOD_TK);
+    parser_retain(p);
     parser_assert_next(p, VAR_TK);
     name = parser_get_str(p);
     parser_assert_prompt(p, INPUT_PROMPT_BLOCK);
@@ -1606,11 +1812,12 @@ static struct ast_module *parser_module(struct parser *p)
 static struct ast_stm *parser_main(struct parser *p)
 {
     struct ast_stm *stm = NULL;
+    size_t line = p->line;
 
     if (parser_get_type(p) == MOD_TK) {
         void *node;
         if ((node = parser_module(p)))
-            stm = ast_stm_new(AST_NODE_MODULE, node);
+            stm = ast_stm_new(AST_NODE_MODULE, node, line);
     } else
         stm = parser_function_main(p);
 
@@ -1621,8 +1828,13 @@ int parser_ast_construct(struct ast_prog *prog, struct parser_meta *meta)
 {
     struct parser parser;
     struct ast_stm *stm = NULL, *next = NULL;
+    struct ast_pool *pool, *prev;
     parser_init(&parser, meta);
 
+    /* the statements of the program share a pool */
+    pool = ast_pool_new();
+    prev = ast_pool_use(pool);
+
     do {
         if (next) {
             next->next = parser_main(&parser);
@@ -1633,11 +1845,76 @@ int parser_ast_construct(struct ast_prog *prog, struct parser_meta *meta)
         }
     } while (parser_get_next(&parser));
 
+    ast_pool_use(prev);
     if (parser_has_error(&parser)) {
-
+        ast_pool_destroy(pool);
         return -1;
     }
+    if (!stm)
+        ast_pool_destroy(pool);
 
     ast_prog_init(prog, stm);
     return 0;
 }
+
+struct parser *parser_new(struct parser_meta *meta)
+{
+    int status = 0;
+    struct parser *p;
+
+    if (meta->set->lexer && ash_tk_set_empty(meta->set))
+        status = lex_stream_next(meta->set->lexer);
+
+    p = ash_alloc(sizeof *p);
+    parser_init(p, meta);
+    if (status < 0)
+        p->error = true;
+    return p;
+}
+
+/* stop reporting syntax errors */
+void parser_quiet(struct parser *p)
+{
+    p->quiet = true;
+}
+
+/*
+parse the next top-level statement; returns 1 when one was
+parsed, 0 at the end of the input and -1 on a syntax error.
+retain is set when the statement defines something the
+runtime may refer to after it has run, otherwise the caller
+may destroy it. the tokens it was parsed from are released
+*/
+int parser_ast_next(struct parser *p, struct ast_stm **stm, bool *retain)
+{
+    size_t count = p->retain;
+    struct ast_pool *pool, *prev;
+    *stm = NULL;
+
+    pool = ast_pool_new();
+    prev = ast_pool_use(pool);
+
+    while (!*stm && !parser_has_error(p) && parser_get_token(p)) {
+        *stm = parser_main(p);
+        if (parser_has_error(p))
+            break;
+
+        parser_get_next(p);
+        ash_tk_set_release(p->set, p->token);
+    }
+
+    ast_pool_use(prev);
+    if (parser_has_error(p) || !*stm) {
+        ast_pool_destroy(pool);
+        *stm = NULL;
+        return (parser_has_error(p)) ? -1: 0;
+    }
+
+    *retain = (p->retain != count) ? true: false;
+    return 1;
+}
+
+void parser_destroy(struct parser *p)
+{
+    ash_free(p);
+}
@@ -26,6 +26,7 @@
 #include "ash/module.h"
 #include "ash/obj.h"
 #include "ash/ops.h"
+#include "ash/prof.h"
 #include "ash/range.h"
 #include "ash/str.h"
 #include "ash/tuple.h"
@@ -35,6 +36,7 @@
 #include "ash/lang/parser.h"
 #include "ash/lang/runtime.h"
 #include "ash/type/array.h"
+#include "ash/type/lines.h"
 #include "ash/type/map.h"
 #include "ash/util/vec.h"
 
@@ -375,7 +377,7 @@ runtime_eval_array(struct ash_runtime_context *context,
         vec = vec_from(argc);
 
         for (size_t i = 0; i < argc; ++i) {
-            vec_push(vec, runtime_eval_expr(context, expr));
+            vec_push(vec, ash_obj_keep(runtime_eval_expr(context, expr)));
             expr = expr->next;
         }
 
@@ -431,7 +433,7 @@ runtime_eval_map(struct ash_runtime_context *context,
 
     while (entry) {
         if ((value = runtime_eval_expr(context, entry->expr)))
-            ash_map_insert(obj, entry->key, value);
+            ash_map_insert(obj, ash_strcpy(entry->key), value);
         entry = entry->next;
     }
 
@@ -445,9 +447,10 @@ runtime_eval_string(struct ash_runtime_context *context,
     const char *fmt;
     struct ash_obj *obj;
 
-    if ((fmt = ash_ops_format(str, &context->env)))
-        str = fmt;
-    obj = ash_str_from(str);
+    /* the literal belongs to the ast, which may be released */
+    if ((fmt = ash_ops_format(str, &context->env)) == str)
+        fmt = ash_strcpy(str);
+    obj = ash_str_from(fmt);
     return obj;
 }
 
@@ -751,6 +754,43 @@ runtime_eval_hash(struct ash_runtime_context *context, struct ast_hash *hash)
     return obj;
 }
 
+struct runtime_subst {
+    struct ash_runtime_context *context;
+    struct ast_stm *stm;
+};
+
+static void runtime_subst_main(void *data)
+{
+    struct runtime_subst *subst = data;
+    runtime_exec_stm(subst->context, subst->stm);
+}
+
+static struct ash_obj *
+runtime_eval_subst(struct ash_runtime_context *context, struct ast_subst *subst)
+{
+    struct runtime_subst data = {
+        .context = context,
+        .stm = subst->stm
+    };
+
+    if (subst->type == AST_SUBST_LINES) {
+        int fd, pid;
+        if ((fd = ash_exec_subshell(runtime_subst_main, &data, &pid)) == -1)
+            return NULL;
+        return ash_lines_from(fd, pid);
+    }
+
+    char *output;
+    size_t len;
+    if (!(output = ash_exec_capture(runtime_subst_main, &data, &len)))
+        return NULL;
+
+    /* trailing newlines are removed from the output */
+    while (len > 0 && output[len - 1] == '\n')
+        output[--len] = '\0';
+    return ash_str_from(output);
+}
+
 static struct ash_obj *
 runtime_eval_expr(struct ash_runtime_context *context, struct ast_expr *expr)
 {
@@ -776,6 +816,8 @@ runtime_eval_expr(struct ash_runtime_context *context, struct ast_expr *expr)
         obj = runtime_eval_match(context, expr->expr);
     else if (type == AST_EXPR_HASH)
         obj = runtime_eval_hash(context, expr->expr);
+    else if (type == AST_EXPR_SUBST)
+        obj = runtime_eval_subst(context, expr->expr);
 
     return obj;
 }
@@ -843,21 +885,43 @@ runtime_assign(struct ash_runtime_context *context, struct ast_assign *assign)
         ash_module_var_set(module, id, obj);
 }
 
-static void
-runtime_command(struct ash_runtime_context *context, struct ast_command *command)
+static struct vec *
+runtime_command_io(struct ash_runtime_context *context, struct ast_io *aio)
+{
+    struct vec *io;
+    struct ash_obj *obj;
+    struct ash_exec_redirection *redirection;
+    const char *target;
+
+    io = vec_new();
+    for (; aio; aio = aio->next) {
+        if (!(obj = runtime_eval_expr(context, aio->expr)) ||
+            !(obj = ash_obj_str(obj)) || !(target = ash_str_get(obj))) {
+            ash_print_err("invalid redirection target");
+            vec_for_each(io, ash_free);
+            vec_destroy(io);
+            return NULL;
+        }
+
+        redirection = ash_alloc(sizeof *redirection);
+        redirection->type = aio->type;
+        redirection->fd = aio->fd;
+        redirection->target = target;
+        vec_push(io, redirection);
+    }
+
+    return io;
+}
+
+static struct vec *
+runtime_command_argv(struct ash_runtime_context *context,
+                     struct ast_command *command)
 {
-    struct ash_runtime_env renv;
-    struct ash_module *mod;
-    struct ash_env *env;
     struct ash_obj *obj;
     struct ast_expr *expr;
+    struct vec *objs, *argv;
 
     expr = command->expr;
-    mod = runtime_context_module(context);
-    env = runtime_context_env(context);
-    runtime_env_init(&renv, mod, env);
-
-    struct vec *objs;
     objs = vec_from(command->length);
 
     do {
@@ -867,15 +931,95 @@ runtime_command(struct ash_runtime_context *context, struct ast_command *command
         }
     } while ((expr = expr->next));
 
-    if (vec_len(objs) > 0) {
-        struct vec *vec;
-        vec = vec_map(objs, (void *(*)(void *))ash_str_get);
-        if (vec_len(vec) > 0)
-            ash_exec_command(vec, &renv);
-        vec_destroy(vec);
+    argv = vec_map(objs, (void *(*)(void *))ash_str_get);
+    vec_destroy(objs);
+    return argv;
+}
+
+static void runtime_command_seq_free(struct ash_exec_seq *seq)
+{
+    vec_destroy(seq->argv);
+    if (seq->io) {
+        vec_for_each(seq->io, ash_free);
+        vec_destroy(seq->io);
     }
+    ash_free(seq);
+}
 
-    vec_destroy(objs);
+static struct ash_exec_seq *
+runtime_command_seq(struct ash_runtime_context *context,
+                    struct ast_command *command)
+{
+    struct ash_exec_seq *seq;
+    seq = ash_alloc(sizeof *seq);
+    seq->argv = runtime_command_argv(context, command);
+    seq->io = NULL;
+    seq->redirect = (command->redirect) ?
+        command->redirect->type: ASH_DIRECT;
+
+    if (command->io && !(seq->io = runtime_command_io(context, command->io))) {
+        runtime_command_seq_free(seq);
+        return NULL;
+    }
+
+    return seq;
+}
+
+static void
+runtime_command_pipeline(struct ash_runtime_context *context,
+                         struct ast_command *command,
+                         struct ash_runtime_env *renv)
+{
+    struct vec *pipeline;
+    struct ash_exec_seq *seq;
+    bool valid = true;
+
+    pipeline = vec_new();
+    for (; command; command = command->redirect->command) {
+        if (!(seq = runtime_command_seq(context, command))) {
+            valid = false;
+            break;
+        }
+
+        vec_push(pipeline, seq);
+        if (vec_len(seq->argv) == 0) {
+            ash_print_err("empty command in pipeline");
+            valid = false;
+            break;
+        }
+
+        if (!command->redirect)
+            break;
+    }
+
+    if (valid)
+        ash_exec_pipeline(pipeline, renv);
+
+    vec_for_each(pipeline, (void (*)(void *))runtime_command_seq_free);
+    vec_destroy(pipeline);
+}
+
+static void
+runtime_command(struct ash_runtime_context *context, struct ast_command *command)
+{
+    struct ash_runtime_env renv;
+    struct ash_module *mod;
+    struct ash_env *env;
+    struct ash_exec_seq *seq;
+
+    mod = runtime_context_module(context);
+    env = runtime_context_env(context);
+    runtime_env_init(&renv, mod, env);
+
+    if (command->redirect)
+        return runtime_command_pipeline(context, command, &renv);
+
+    if (!(seq = runtime_command_seq(context, command)))
+        return;
+
+    if (vec_len(seq->argv) > 0)
+        ash_exec_command(seq->argv, seq->io, &renv);
+    runtime_command_seq_free(seq);
 }
 
 static struct ash_obj *
@@ -1036,6 +1180,8 @@ static void runtime_for(struct ash_runtime_context *context,
         }
     }
 
+    /* a stream of lines is consumed by the loop */
+    ash_lines_close(ao);
     runtime_context_env_destroy(context);
 }
 
@@ -1134,6 +1280,7 @@ static int runtime_stm(struct ash_runtime_context *context, struct ast_stm *stm)
 void runtime_exec_stm(struct ash_runtime_context *context, struct ast_stm *stm)
 {
     while (stm) {
+        ash_prof_line(stm->line);
         runtime_stm(context, stm);
         if (!runtime_context_is_run(context))
             break;
@@ -180,13 +180,13 @@ const char *ash_ops_tilde(const char *s)
     if (s[1] == '/')
         ++s;
 
-    size_t max;
+    size_t len;
     char *fmt;
     const char *home;
 
-    max = ash_env_get_pwd_max();
     home = ash_env_get_home();
-    fmt = ash_zalloc(max + 1);
+    len = strlen(home) + strlen(s) + 2;
+    fmt = ash_zalloc(len);
 
     if ((*(++s)))
         sprintf(fmt, "%s%c%s", home, '/', s);
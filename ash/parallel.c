@@ -0,0 +1,443 @@
+/* Copyright 2018 eomain
+   this program is licensed under the 2-clause BSD license
+   see COPYING for the full license info
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ash/ash.h"
+#include "ash/command.h"
+#include "ash/env.h"
+#include "ash/int.h"
+#include "ash/io.h"
+#include "ash/iter.h"
+#include "ash/mem.h"
+#include "ash/obj.h"
+#include "ash/ops.h"
+#include "ash/parallel.h"
+#include "ash/str.h"
+#include "ash/var.h"
+#include "ash/lang/runtime.h"
+#include "ash/type/array.h"
+#include "ash/util/vec.h"
+
+#ifdef ASH_PLATFORM_POSIX
+    #include <sys/types.h>
+    #include <sys/wait.h>
+    #include <unistd.h>
+#endif
+
+/* placeholder substituted by each item in the command template */
+#define PARALLEL_ITEM "{}"
+/* status of a job which could not be executed */
+#define PARALLEL_STATUS_NOEXEC 127
+/* offset added to the signal number of a killed job */
+#define PARALLEL_STATUS_SIGNAL 128
+
+static const char *USAGE =
+    "parallel:\n"
+    "    run a command for each item, keeping several jobs running at once\n"
+    "usage:\n"
+    "    parallel [OPTIONS] COMMAND [ARGS]...\n"
+    "\n"
+    "OPTIONS:\n"
+    "    -j <JOBS>           Number of jobs to keep running\n"
+    "    -i <VARIABLE>       Take the items from an iterable variable\n"
+    "    -g                  Group the output of each job\n"
+    "\n"
+    "Items are read from the lines of standard input unless -i is given.\n"
+    "Each `" PARALLEL_ITEM "` in ARGS is replaced by the item, otherwise the\n"
+    "item is appended. The exit status of every job is collected in item\n"
+    "order into an array stored in the result.\n";
+
+const char *ash_parallel_usage(void)
+{
+    return USAGE;
+}
+
+struct job {
+    pid_t pid;
+    size_t index;
+    /* the output of a grouped job, held until it completes */
+    FILE *out;
+    FILE *err;
+};
+
+struct parallel {
+    size_t jobs;
+    size_t running;
+    bool group;
+    int argc;
+    const char * const *argv;
+    struct job *slots;
+    struct vec *status;
+};
+
+static size_t parallel_jobs_default(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n > 0) ? n : 1;
+}
+
+static void
+parallel_init(struct parallel *p, size_t jobs, bool group,
+              int argc, const char * const *argv)
+{
+    p->jobs = jobs;
+    p->running = 0;
+    p->group = group;
+    p->argc = argc;
+    p->argv = argv;
+    p->slots = ash_zalloc(jobs * sizeof *p->slots);
+    p->status = vec_new();
+}
+
+static char *
+parallel_subst(const char *arg, const char *item, bool *subst)
+{
+    const char *s, *m;
+    size_t n = 0, alen, ilen, plen;
+
+    plen = strlen(PARALLEL_ITEM);
+    for (s = arg; (m = strstr(s, PARALLEL_ITEM)); s = m + plen)
+        n++;
+
+    if (n == 0)
+        return (char *) ash_strcpy(arg);
+
+    *subst = true;
+    alen = strlen(arg);
+    ilen = strlen(item);
+
+    char *str, *d;
+    str = ash_alloc(alen + n * ilen - n * plen + 1);
+    d = str;
+    for (s = arg; (m = strstr(s, PARALLEL_ITEM)); s = m + plen) {
+        memcpy(d, s, m - s);
+        d += m - s;
+        memcpy(d, item, ilen);
+        d += ilen;
+    }
+    strcpy(d, s);
+    return str;
+}
+
+static char **
+parallel_argv(struct parallel *p, const char *item)
+{
+    char **argv;
+    bool subst = false;
+    int i;
+
+    argv = ash_alloc((p->argc + 2) * sizeof *argv);
+    for (i = 0; i < p->argc; ++i)
+        argv[i] = parallel_subst(p->argv[i], item, &subst);
+
+    if (!subst)
+        argv[i++] = (char *) ash_strcpy(item);
+    argv[i] = NULL;
+    return argv;
+}
+
+static void parallel_argv_free(char **argv)
+{
+    for (char **arg = argv; *arg; ++arg)
+        ash_free(*arg);
+    ash_free(argv);
+}
+
+static void parallel_output(FILE *out, int to)
+{
+    char buf[BUFSIZ];
+    ssize_t n;
+    int fd;
+
+    fd = fileno(out);
+    lseek(fd, 0, SEEK_SET);
+    ash_flush();
+
+    while ((n = read(fd, buf, sizeof buf)) > 0) {
+        if (write(to, buf, n) != n)
+            break;
+    }
+    fclose(out);
+}
+
+static struct job *parallel_find(struct parallel *p, pid_t pid)
+{
+    for (size_t i = 0; i < p->jobs; ++i) {
+        if (p->slots[i].pid == pid)
+            return &p->slots[i];
+    }
+    return NULL;
+}
+
+/* the running job started first */
+static struct job *parallel_oldest(struct parallel *p)
+{
+    struct job *oldest = NULL;
+
+    for (size_t i = 0; i < p->jobs; ++i) {
+        if (p->slots[i].pid > 0 &&
+            (!oldest || p->slots[i].index < oldest->index))
+            oldest = &p->slots[i];
+    }
+    return oldest;
+}
+
+static void parallel_done(struct parallel *p, struct job *job, int status)
+{
+    int code;
+
+    if (WIFSIGNALED(status))
+        code = PARALLEL_STATUS_SIGNAL + WTERMSIG(status);
+    else
+        code = WEXITSTATUS(status);
+
+    if (job->out)
+        parallel_output(job->out, STDOUT_FILENO);
+    if (job->err)
+        parallel_output(job->err, STDERR_FILENO);
+
+    vec_set(p->status, job->index, ash_int_from(code));
+    job->pid = 0;
+    job->out = NULL;
+    job->err = NULL;
+    p->running--;
+}
+
+/* reap a job that has completed, without blocking */
+static bool parallel_reap(struct parallel *p)
+{
+    struct job *job;
+    int status;
+
+    for (size_t i = 0; i < p->jobs; ++i) {
+        job = &p->slots[i];
+        if (job->pid > 0 && waitpid(job->pid, &status, WNOHANG) == job->pid) {
+            parallel_done(p, job, status);
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+wait for any running job to complete and record its exit status.
+only the jobs are reaped, so that the other children of the
+shell, such as the command behind a lines iterator, are left
+for whoever started them. when one of those has exited the
+oldest job is waited on instead
+*/
+static void parallel_wait(struct parallel *p)
+{
+    struct job *job;
+    siginfo_t info;
+    int status;
+
+    for (;;) {
+        if (parallel_reap(p))
+            return;
+
+        info.si_pid = 0;
+        if (waitid(P_ALL, 0, &info, WEXITED | WNOWAIT) == -1) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (parallel_find(p, info.si_pid))
+            continue;
+
+        job = parallel_oldest(p);
+        if (job && waitpid(job->pid, &status, 0) == job->pid) {
+            parallel_done(p, job, status);
+            return;
+        }
+        if (!job || errno != EINTR)
+            break;
+    }
+
+    /* the jobs can no longer be waited on */
+    for (size_t i = 0; i < p->jobs; ++i) {
+        job = &p->slots[i];
+        if (job->out)
+            fclose(job->out);
+        if (job->err)
+            fclose(job->err);
+        job->pid = 0;
+        job->out = job->err = NULL;
+    }
+    p->running = 0;
+}
+
+static void parallel_spawn(struct parallel *p, const char *item)
+{
+    struct job *job;
+    char **argv;
+    FILE *out = NULL, *err = NULL;
+    pid_t pid;
+
+    if (p->running == p->jobs)
+        parallel_wait(p);
+
+    job = parallel_find(p, 0);
+    if (p->group && (!(out = tmpfile()) || !(err = tmpfile())))
+        ash_print_errno("parallel");
+
+    argv = parallel_argv(p, item);
+    ash_flush();
+
+    pid = fork();
+    if (pid == -1) {
+        ash_print_err("unable to fork process!");
+        vec_push(p->status, ash_int_from(PARALLEL_STATUS_NOEXEC));
+        if (out)
+            fclose(out);
+        if (err)
+            fclose(err);
+    } else if (pid == 0) {
+        if (out)
+            dup2(fileno(out), STDOUT_FILENO);
+        if (err)
+            dup2(fileno(err), STDERR_FILENO);
+        execvp(argv[0], argv);
+        ash_print(PNAME ": '%s': %s \n", argv[0], strerror(errno));
+        ash_flush();
+        _exit(PARALLEL_STATUS_NOEXEC);
+    } else {
+        job->pid = pid;
+        job->index = vec_len(p->status);
+        job->out = out;
+        job->err = err;
+        vec_push(p->status, NULL);
+        p->running++;
+    }
+
+    parallel_argv_free(argv);
+}
+
+static void parallel_iterable(struct parallel *p, struct ash_obj *obj)
+{
+    struct ash_iter iter;
+    struct ash_obj *value, *str;
+    const char *item;
+
+    ash_iter_init(&iter, obj);
+    while ((value = ash_iter_next(&iter))) {
+        if ((str = ash_obj_str(value)) && (item = ash_str_get(str)))
+            parallel_spawn(p, item);
+    }
+}
+
+static void parallel_lines(struct parallel *p)
+{
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t len;
+
+    while ((len = getline(&line, &size, stdin)) != -1) {
+        if (len > 0 && line[len - 1] == '\n')
+            line[--len] = '\0';
+        parallel_spawn(p, line);
+    }
+    clearerr(stdin);
+    free(line);
+}
+
+static int parallel_finish(struct parallel *p, struct ash_command_env *env)
+{
+    int status = ASH_STATUS_OK;
+    struct ash_obj *code;
+
+    while (p->running > 0)
+        parallel_wait(p);
+
+    for (size_t i = 0; i < vec_len(p->status); ++i) {
+        code = vec_get(p->status, i);
+        if (!code) {
+            code = ash_int_from(PARALLEL_STATUS_NOEXEC);
+            vec_set(p->status, i, code);
+        }
+        if (ash_int_get(code) != 0)
+            status = ASH_STATUS_ERR;
+    }
+
+    ash_free(p->slots);
+    ash_command_env_set_result(env, ash_array_from(p->status));
+    return status;
+}
+
+int ash_parallel_env(int argc, const char * const *argv,
+                     struct ash_command_env *env)
+{
+    const char *opt;
+    const char *name = NULL;
+    size_t jobs = 0;
+    bool group = false;
+    struct ash_obj *obj = NULL;
+    struct ash_var *var;
+    struct parallel p;
+    int i;
+
+    for (i = 1; i < argc; ++i) {
+        opt = argv[i];
+
+        if (opt[0] != '-' || strlen(opt) != 2)
+            break;
+
+        char c = opt[1];
+        if (c == 'g') {
+            group = true;
+        } else if (c == 'j' && i + 1 < argc) {
+            if (!ash_stoi_check(argv[++i]) || atoi(argv[i]) <= 0) {
+                ash_print_err("parallel: invalid number of jobs");
+                return ASH_STATUS_ERR;
+            }
+            jobs = atoi(argv[i]);
+        } else if (c == 'i' && i + 1 < argc) {
+            name = argv[++i];
+        } else {
+            break;
+        }
+    }
+
+    if (i == argc) {
+        ash_print("%s", USAGE);
+        return ASH_STATUS_ERR;
+    }
+
+    if (name) {
+        if (!(var = runtime_get_var(env->env, name)))
+            var = ash_var_get(name);
+        if (!(obj = ash_var_obj(var))) {
+            ash_print(PNAME ": parallel: '%s': undefined variable\n", name);
+            return ASH_STATUS_ERR;
+        }
+    }
+
+    if (jobs == 0)
+        jobs = parallel_jobs_default();
+    parallel_init(&p, jobs, group, argc - i, &argv[i]);
+
+    if (obj)
+        parallel_iterable(&p, obj);
+    else
+        parallel_lines(&p);
+
+    return parallel_finish(&p, env);
+}
@@ -13,7 +13,7 @@
    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
-
+#include <stdlib.h>
 #include <string.h>
 
 #include "ash/command.h"
@@ -25,49 +25,295 @@
 #include "ash/str.h"
 #include "ash/var.h"
 #include "ash/lang/runtime.h"
+#include "ash/type/array.h"
+#include "ash/util/readbuf.h"
+#include "ash/util/vec.h"
+
+#ifdef ASH_PLATFORM_POSIX
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
 
-#define MAX_INPUT_SIZE 2048
+/* size of the buffer for input that is not a terminal */
+#define READ_BUFSIZ 65536
 
 static const char *USAGE =
     "read:\n"
     "    read from standard input\n"
     "usage:\n"
-    "    read [OPTIONS] [VARIABLE]\n"
+    "    read [OPTIONS] [VARIABLE]...\n"
+    "\n"
+    "    with more than one variable the input is split on\n"
+    "    whitespace and the last variable receives the rest\n"
     "\n"
     "OPTIONS:\n"
-    "    -p <PROMPT>         Display as prompt\n";
+    "    -p <PROMPT>         Display as prompt\n"
+    "    -d <DELIM>          Read until DELIM rather than a newline\n"
+    "    -n <COUNT>          Read at most COUNT characters\n"
+    "    -a <ARRAY>          Split the input into an array\n";
 
 const char *ash_read_usage(void)
 {
     return USAGE;
 }
 
-static int ash_read_input(const char *var, const char *prompt,
-                          struct ash_runtime_env *renv)
+struct read_option {
+    const char *prompt;
+    const char *array;
+    char delim;
+    size_t count;
+};
+
+/*
+input that is not a terminal is read through a buffer rather
+than the line editor. a regular file is read a block at a time
+and repositioned after each read so that the unread input
+remains for other commands; its buffer is reused for as long
+as nothing else has moved the offset. input that cannot be
+repositioned, such as a pipe, is read a byte at a time so that
+nothing past the delimiter is consumed
+*/
+struct read_buffer {
+    dev_t dev;
+    ino_t ino;
+    bool seekable;
+    /* the file offset of the end of the buffer */
+    off_t pos;
+    struct readbuf input;
+};
+
+static struct read_buffer input = {
+    .pos = 0,
+    .input = {
+        .buf = NULL,
+        .size = 0,
+        .head = 0,
+        .tail = 0
+    }
+};
+
+static inline off_t read_buffer_offset(struct read_buffer *rb)
+{
+    return rb->pos - (off_t) (rb->input.tail - rb->input.head);
+}
+
+static void read_buffer_sync(struct read_buffer *rb)
 {
-    const char *input;
+    off_t offset;
+    struct stat st;
+
+    if (fstat(STDIN_FILENO, &st) == -1)
+        return;
+
+    if (st.st_dev != rb->dev || st.st_ino != rb->ino) {
+        rb->dev = st.st_dev;
+        rb->ino = st.st_ino;
+        rb->input.head = rb->input.tail = 0;
+    }
 
-    if ((input = ash_scan_prompt(prompt))) {
-        if (!var) {
-            ash_free((char *)input);
-            return -1;
+    rb->seekable = false;
+    if (S_ISREG(st.st_mode) &&
+        (offset = lseek(STDIN_FILENO, 0, SEEK_CUR)) != -1) {
+        if (offset != read_buffer_offset(rb)) {
+            rb->input.head = rb->input.tail = 0;
+            rb->pos = offset;
         }
+        rb->seekable = true;
+    }
+
+    if (!rb->input.buf)
+        readbuf_init(&rb->input, READ_BUFSIZ);
+}
 
-        struct ash_obj *obj;
-        obj = ash_str_from(ash_strcpy(input));
-        runtime_set_var(renv, var, obj);
+/*
+read more input into the buffer, returns the number of bytes read;
+input that cannot be repositioned is read a byte at a time
+*/
+static size_t read_buffer_fill(struct read_buffer *rb)
+{
+    size_t n;
+
+    if (rb->seekable && lseek(STDIN_FILENO, rb->pos, SEEK_SET) == -1)
         return 0;
+
+    n = readbuf_fill(&rb->input, STDIN_FILENO, rb->seekable ? 0: 1);
+    rb->pos += n;
+    return n;
+}
+
+/* leave the offset of a regular file after the input consumed */
+static void read_buffer_release(struct read_buffer *rb)
+{
+    if (!rb->seekable)
+        return;
+
+    if (lseek(STDIN_FILENO, read_buffer_offset(rb), SEEK_SET) == -1)
+        rb->input.head = rb->input.tail = 0;
+}
+
+/*
+read up to the delimiter or `count` characters, when non-zero;
+returns NULL at the end of the input
+*/
+static char *read_buffer_get(struct read_buffer *rb, char delim, size_t count)
+{
+    char *start, *end, *s;
+    size_t len, scan;
+
+    read_buffer_sync(rb);
+
+    for (;;) {
+        start = rb->input.buf + rb->input.head;
+        len = rb->input.tail - rb->input.head;
+        scan = (count && len > count) ? count: len;
+
+        if ((end = memchr(start, delim, scan))) {
+            len = end - start;
+            rb->input.head += len + 1;
+            break;
+        }
+
+        if (count && len >= count) {
+            len = count;
+            rb->input.head += len;
+            break;
+        }
+
+        if (read_buffer_fill(rb) == 0) {
+            if (len == 0)
+                return NULL;
+            /* the fill may have moved the input */
+            start = rb->input.buf + rb->input.head;
+            rb->input.head = rb->input.tail;
+            break;
+        }
+    }
+
+    s = ash_alloc(len + 1);
+    memcpy(s, start, len);
+    s[len] = '\0';
+
+    read_buffer_release(rb);
+    return s;
+}
+
+static char *read_terminal(const struct read_option *option)
+{
+    const char *line;
+    char *s;
+
+    if (!(line = ash_scan_prompt(option->prompt)))
+        return NULL;
+
+    s = (char *) ash_strcpy(line);
+    if (option->count && strlen(s) > option->count)
+        s[option->count] = '\0';
+    return s;
+}
+
+static inline bool read_is_space(char c)
+{
+    return (c == ' ' || c == '\t' || c == '\n');
+}
+
+/*
+copy the next whitespace separated field, or with `rest`
+the remainder of the input, advancing past it
+*/
+static char *read_field(const char **s, bool rest)
+{
+    const char *start, *end;
+    char *field;
+
+    for (start = *s; read_is_space(*start); ++start);
+    if (!*start)
+        return NULL;
+
+    if (rest) {
+        end = start + strlen(start);
+        while (end > start && read_is_space(end[-1]))
+            --end;
+    } else {
+        for (end = start; *end && !read_is_space(*end); ++end);
     }
 
-    return -1;
+    *s = end;
+    field = ash_alloc((end - start) + 1);
+    memcpy(field, start, end - start);
+    field[end - start] = '\0';
+    return field;
+}
+
+static void read_assign_array(const char *name, const char *line,
+                              struct ash_runtime_env *renv)
+{
+    char *field;
+    struct vec *vec;
+
+    vec = vec_new();
+    while ((field = read_field(&line, false)))
+        vec_push(vec, ash_str_from(field));
+
+    runtime_set_var(renv, name, ash_array_from(vec));
+}
+
+static void read_assign(const char * const *vars, int count,
+                        const char *line, struct ash_runtime_env *renv)
+{
+    char *field;
+
+    for (int i = 0; i < count; ++i) {
+        if (!(field = read_field(&line, i == count - 1)))
+            field = (char *) ash_strcpy("");
+        runtime_set_var(renv, vars[i], ash_str_from(field));
+    }
+}
+
+static int ash_read_input(const char * const *vars, int count,
+                          const struct read_option *option,
+                          struct ash_runtime_env *renv)
+{
+    char *line;
+
+#ifdef ASH_PLATFORM_POSIX
+    if (!isatty(STDIN_FILENO))
+        line = read_buffer_get(&input, option->delim, option->count);
+    else
+#endif
+        line = read_terminal(option);
+
+    if (!line)
+        return -1;
+
+    if (option->array) {
+        read_assign_array(option->array, line, renv);
+        ash_free(line);
+    } else if (count == 1) {
+        /* a single variable receives the input unchanged */
+        runtime_set_var(renv, vars[0], ash_str_from(line));
+    } else if (count > 1) {
+        read_assign(vars, count, line, renv);
+        ash_free(line);
+    } else {
+        ash_free(line);
+        return -1;
+    }
+
+    return 0;
 }
 
 int ash_read_env(int argc, const char * const *argv,
                  struct ash_command_env *env)
 {
     const char *opt;
-    const char *prompt = NULL;
-    const char *var = NULL;
+    const char * const *vars = NULL;
+    int count = 0;
+    struct read_option option = {
+        .prompt = NULL,
+        .array = NULL,
+        .delim = '\n',
+        .count = 0
+    };
 
     for (int i = 1; i < argc; ++i) {
         opt = argv[i];
@@ -75,16 +321,26 @@ int ash_read_env(int argc, const char * const *argv,
         if (opt[0] == '-' && strlen(opt) == 2) {
             char c = opt[1];
 
-            if (c == 'p') {
-                if (i < argc)
-                    prompt = argv[++i];
+            if (!strchr("padn", c) || i + 1 >= argc) {
+                ash_print("%s", USAGE);
+                return -1;
             }
 
+            if (c == 'p')
+                option.prompt = argv[++i];
+            else if (c == 'a')
+                option.array = argv[++i];
+            else if (c == 'd')
+                option.delim = argv[++i][0];
+            else
+                option.count = strtoul(argv[++i], NULL, 10);
+
         } else {
-            var = argv[i];
+            vars = &argv[i];
+            count = argc - i;
             break;
         }
     }
 
-    return ash_read_input(var, prompt, env->env);
+    return ash_read_input(vars, count, &option, env->env);
 }
@@ -18,6 +18,7 @@
 
 #include "ash/ash.h"
 #include "ash/env.h"
+#include "ash/io.h"
 #include "ash/ops.h"
 #include "ash/sleep.h"
 
@@ -46,6 +47,7 @@ int ash_sleep(int argc, const char * const *argv)
 
     useconds_t msecs;
     msecs = atoi(argv[1]);
+    ash_flush();
     usleep(msecs);
 
     return ASH_STATUS_OK;
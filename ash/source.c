@@ -38,10 +38,8 @@ int ash_source_env(int argc, const char * const *argv,
     struct script_meta meta;
     ash_script_meta_get(&meta);
 
-    for (int i = 1; i < argc; ++i) {
-        if (ash_script_load(argv[i], false) == -1)
-            status = ASH_STATUS_ERR;
-    }
+    if (argc > 1 && ash_script_load_all(argc - 1, &argv[1]) == -1)
+        status = ASH_STATUS_ERR;
 
     ash_script_meta_set(&meta);
 
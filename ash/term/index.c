@@ -0,0 +1,560 @@
+/* Copyright 2018 eomain
+   this program is licensed under the 2-clause BSD license
+   see COPYING for the full license info
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ash/mem.h"
+#include "ash/ops.h"
+#include "ash/type.h"
+#include "ash/term/index.h"
+
+/* initial number of slots in the trigram table */
+#define INDEX_SLOTS 1024
+/* marks the trigram a line begins with */
+#define INDEX_START (1u << 24)
+
+/*
+each history line is numbered in the order it was added and
+every trigram it contains maps to the ascending list of the
+lines containing it. a substring query of three or more
+characters is answered by verifying only the lines on the
+shortest list among its trigrams, rather than every line.
+the last two characters of a line are also posted with the
+terminating nul, so every pair of characters in a line starts
+one of its trigrams and a two character query is answered from
+the lists of the trigrams it begins. the trigram a line begins
+with is posted a second time, marked, so that the lines a query
+is a prefix of are found before any other. a single character
+is searched for only in the lines whose mask of the characters
+they hold, folded to 64 bits, includes it.
+only the last `limit` lines are searched, as many as are kept
+in the history; once twice that many have been added the older
+lines are dropped and the table is rebuilt from the rest
+*/
+struct index_posting {
+    uint32_t *ids;
+    size_t len;
+    size_t cap;
+};
+
+struct index_slot {
+    bool used;
+    uint32_t gram;
+    struct index_posting posting;
+};
+
+struct index {
+    const char **lines;
+    uint64_t *masks;
+    size_t len;
+    size_t cap;
+    struct index_slot *slots;
+    size_t size;
+    size_t used;
+    size_t limit;
+};
+
+static struct index term_index = {
+    .lines = NULL,
+    .masks = NULL,
+    .len = 0,
+    .cap = 0,
+    .slots = NULL,
+    .size = 0,
+    .used = 0,
+    .limit = 0
+};
+
+static inline uint32_t index_gram(const char *s)
+{
+    const unsigned char *u = (const unsigned char *) s;
+    return ((uint32_t) u[0] << 16) | ((uint32_t) u[1] << 8) | u[2];
+}
+
+static inline uint64_t index_bit(char c)
+{
+    return (uint64_t) 1 << ((unsigned char) c & 63);
+}
+
+static inline size_t index_hash(uint32_t gram, size_t size)
+{
+    return (size_t) ((gram * 2654435761u) & (size - 1));
+}
+
+static struct index_slot *index_find(struct index *ix, uint32_t gram)
+{
+    size_t i;
+
+    if (!ix->slots)
+        return NULL;
+
+    i = index_hash(gram, ix->size);
+    while (ix->slots[i].used) {
+        if (ix->slots[i].gram == gram)
+            return &ix->slots[i];
+        i = (i + 1) & (ix->size - 1);
+    }
+    return NULL;
+}
+
+static struct index_slot *index_slot(struct index *ix, uint32_t gram);
+
+/* keep the table at most half full */
+static void index_grow(struct index *ix)
+{
+    struct index_slot *slots = ix->slots, *slot;
+    size_t size = ix->size;
+
+    ix->size = (size) ? size * 2: INDEX_SLOTS;
+    ix->slots = ash_zalloc(ix->size * sizeof *ix->slots);
+    ix->used = 0;
+
+    for (size_t i = 0; i < size; ++i) {
+        if (slots[i].used) {
+            slot = index_slot(ix, slots[i].gram);
+            slot->posting = slots[i].posting;
+        }
+    }
+
+    if (slots)
+        ash_free(slots);
+}
+
+static struct index_slot *index_slot(struct index *ix, uint32_t gram)
+{
+    size_t i;
+
+    if ((ix->used + 1) * 2 > ix->size)
+        index_grow(ix);
+
+    i = index_hash(gram, ix->size);
+    while (ix->slots[i].used) {
+        if (ix->slots[i].gram == gram)
+            return &ix->slots[i];
+        i = (i + 1) & (ix->size - 1);
+    }
+
+    ix->slots[i].used = true;
+    ix->slots[i].gram = gram;
+    ix->used++;
+    return &ix->slots[i];
+}
+
+static void index_posting_add(struct index_posting *posting, uint32_t id)
+{
+    /* a trigram repeated within a line is listed once */
+    if (posting->len && posting->ids[posting->len - 1] == id)
+        return;
+
+    if (posting->len == posting->cap) {
+        posting->cap = (posting->cap) ? posting->cap * 2: 4;
+        posting->ids = (posting->ids) ?
+            ash_realloc(posting->ids, posting->cap * sizeof *posting->ids):
+            ash_alloc(posting->cap * sizeof *posting->ids);
+    }
+    posting->ids[posting->len++] = id;
+}
+
+/* the first line within the limit */
+static inline size_t index_first(struct index *ix)
+{
+    return (ix->limit && ix->len > ix->limit) ? ix->len - ix->limit: 0;
+}
+
+static void index_post(struct index *ix, uint32_t id)
+{
+    const char *line = ix->lines[id];
+    uint32_t start;
+    size_t len;
+
+    len = strlen(line);
+    for (size_t i = 0; i + 2 <= len; ++i)
+        index_posting_add(&index_slot(ix, index_gram(&line[i]))->posting, id);
+
+    start = (len >= 2) ? index_gram(line): (uint32_t) line[0] << 16;
+    index_posting_add(&index_slot(ix, INDEX_START | start)->posting, id);
+
+    ix->masks[id] = 0;
+    for (size_t i = 0; i < len; ++i)
+        ix->masks[id] |= index_bit(line[i]);
+}
+
+static void index_slots_free(struct index *ix)
+{
+    for (size_t i = 0; i < ix->size; ++i) {
+        if (ix->slots[i].used && ix->slots[i].posting.ids)
+            ash_free(ix->slots[i].posting.ids);
+    }
+
+    if (ix->slots)
+        ash_free(ix->slots);
+
+    ix->slots = NULL;
+    ix->size = ix->used = 0;
+}
+
+/* drop the lines beyond the limit and index the rest again */
+static void index_trim(struct index *ix)
+{
+    size_t first = index_first(ix);
+
+    for (size_t i = 0; i < first; ++i)
+        ash_free((char *)ix->lines[i]);
+
+    ix->len -= first;
+    memmove(ix->lines, ix->lines + first, ix->len * sizeof *ix->lines);
+    memmove(ix->masks, ix->masks + first, ix->len * sizeof *ix->masks);
+
+    index_slots_free(ix);
+    for (size_t id = 0; id < ix->len; ++id)
+        index_post(ix, id);
+}
+
+void ash_term_index_limit(size_t limit)
+{
+    term_index.limit = limit;
+}
+
+void ash_term_index_add(const char *line)
+{
+    struct index *ix = &term_index;
+
+    if (!line || !*line)
+        return;
+
+    if (ix->limit && ix->len >= ix->limit * 2)
+        index_trim(ix);
+
+    if (ix->len == ix->cap) {
+        ix->cap = (ix->cap) ? ix->cap * 2: 256;
+        ix->lines = (ix->lines) ?
+            ash_realloc(ix->lines, ix->cap * sizeof *ix->lines):
+            ash_alloc(ix->cap * sizeof *ix->lines);
+        ix->masks = (ix->masks) ?
+            ash_realloc(ix->masks, ix->cap * sizeof *ix->masks):
+            ash_alloc(ix->cap * sizeof *ix->masks);
+    }
+
+    ix->lines[ix->len] = ash_strcpy(line);
+    index_post(ix, ix->len++);
+}
+
+void ash_term_index_clear(void)
+{
+    struct index *ix = &term_index;
+
+    for (size_t i = 0; i < ix->len; ++i)
+        ash_free((char *)ix->lines[i]);
+
+    if (ix->lines)
+        ash_free(ix->lines);
+    if (ix->masks)
+        ash_free(ix->masks);
+
+    index_slots_free(ix);
+    ix->lines = NULL;
+    ix->masks = NULL;
+    ix->len = ix->cap = 0;
+}
+
+/*
+matches are ranked by how well they match, then by recency:
+a line beginning with the query ranks above one containing it
+at the start of a word, which ranks above any other substring.
+lines sharing enough trigrams with the query rank below those
+*/
+enum index_rank {
+    RANK_FUZZY,
+    RANK_SUBSTRING,
+    RANK_WORD,
+    RANK_PREFIX
+};
+
+struct index_match {
+    uint32_t id;
+    uint32_t rank;
+};
+
+struct index_search {
+    const char *query;
+    size_t qlen;
+    /* the oldest line searched */
+    size_t first;
+    /* the best rank a line not yet verified can have */
+    uint32_t best;
+    struct index_match *matches;
+    size_t len;
+    size_t max;
+};
+
+static inline bool index_match_better(struct index_match *a,
+                                      struct index_match *b)
+{
+    return (a->rank != b->rank) ? a->rank > b->rank: a->id > b->id;
+}
+
+/* insert a match in order, keeping only the best `max` distinct lines */
+static void index_search_add(struct index_search *search,
+                             uint32_t id, uint32_t rank)
+{
+    struct index_match match = { .id = id, .rank = rank };
+    const char *line = term_index.lines[id];
+    size_t i;
+
+    if (search->len == search->max &&
+        !index_match_better(&match, &search->matches[search->len - 1]))
+        return;
+
+    for (i = 0; i < search->len; ++i) {
+        if (strcmp(term_index.lines[search->matches[i].id], line) == 0) {
+            if (!index_match_better(&match, &search->matches[i]))
+                return;
+            memmove(&search->matches[i], &search->matches[i + 1],
+                    (search->len - i - 1) * sizeof match);
+            search->len--;
+            break;
+        }
+    }
+
+    for (i = search->len; i > 0; --i) {
+        if (!index_match_better(&match, &search->matches[i - 1]))
+            break;
+    }
+
+    if (i >= search->max)
+        return;
+
+    if (search->len == search->max)
+        search->len--;
+    memmove(&search->matches[i + 1], &search->matches[i],
+            (search->len - i) * sizeof match);
+    search->matches[i] = match;
+    search->len++;
+}
+
+/* no line older than the matches found can rank above them */
+static inline bool index_search_done(struct index_search *search)
+{
+    return (search->len == search->max &&
+            search->matches[search->len - 1].rank >= search->best);
+}
+
+static void index_search_verify(struct index_search *search, uint32_t id)
+{
+    const char *line, *s;
+    uint32_t rank;
+
+    line = term_index.lines[id];
+    if (!(s = strstr(line, search->query)))
+        return;
+
+    if (s == line)
+        rank = RANK_PREFIX;
+    else if (s[-1] == ' ' || s[-1] == '\t' || s[-1] == '/')
+        rank = RANK_WORD;
+    else
+        rank = RANK_SUBSTRING;
+
+    index_search_add(search, id, rank);
+}
+
+/* verify the marked lines newest first, until no older line can rank higher */
+static void index_search_marked(struct index_search *search, uint8_t *marked)
+{
+    for (size_t id = term_index.len; id > search->first; --id) {
+        if (!marked[id - 1 - search->first])
+            continue;
+        index_search_verify(search, id - 1);
+        if (index_search_done(search))
+            break;
+    }
+}
+
+/* verify the listed lines newest first */
+static void index_search_posting(struct index_search *search,
+                                 struct index_posting *posting)
+{
+    for (size_t j = posting->len; j > 0; --j) {
+        if (posting->ids[j - 1] < search->first)
+            break;
+        index_search_verify(search, posting->ids[j - 1]);
+        if (index_search_done(search))
+            break;
+    }
+}
+
+/* verify the lines on both lists newest first, keeping only prefixes */
+static void index_search_both(struct index_search *search,
+                              struct index_posting *a,
+                              struct index_posting *b)
+{
+    size_t j = a->len, k = b->len;
+    uint32_t id;
+
+    while (j > 0 && k > 0) {
+        if (a->ids[j - 1] < search->first || b->ids[k - 1] < search->first)
+            break;
+
+        if (a->ids[j - 1] > b->ids[k - 1]) {
+            j--;
+        } else if (a->ids[j - 1] < b->ids[k - 1]) {
+            k--;
+        } else {
+            id = a->ids[--j];
+            if (strncmp(term_index.lines[id], search->query, search->qlen) == 0)
+                index_search_add(search, id, RANK_PREFIX);
+            if (index_search_done(search))
+                break;
+            k--;
+        }
+    }
+}
+
+/* verify the lines of every trigram beginning with the given pair */
+static void index_search_pair(struct index_search *search, uint32_t pair)
+{
+    struct index_slot *slot;
+    struct index_posting *posting;
+    uint8_t *marked;
+
+    marked = ash_zalloc(term_index.len - search->first);
+    for (uint32_t c = 0; c <= UINT8_MAX; ++c) {
+        if (!(slot = index_find(&term_index, pair | c)))
+            continue;
+
+        posting = &slot->posting;
+        for (size_t j = posting->len; j > 0; --j) {
+            if (posting->ids[j - 1] < search->first)
+                break;
+            marked[posting->ids[j - 1] - search->first] = 1;
+        }
+    }
+
+    index_search_marked(search, marked);
+    ash_free(marked);
+}
+
+static void index_search_fuzzy(struct index_search *search)
+{
+    struct index_slot *slot;
+    struct index_posting *posting;
+    uint16_t *shared;
+    uint32_t id;
+    size_t grams = search->qlen - 2, need, found = 0;
+
+    /* at least half of the query trigrams must be shared */
+    need = (grams + 1) / 2;
+    for (size_t i = 0; i < grams; ++i) {
+        if (index_find(&term_index, index_gram(&search->query[i])))
+            found++;
+    }
+    if (found < need)
+        return;
+
+    shared = ash_zalloc((term_index.len - search->first) * sizeof *shared);
+    for (size_t i = 0; i < grams; ++i) {
+        slot = index_find(&term_index, index_gram(&search->query[i]));
+        if (!slot)
+            continue;
+
+        posting = &slot->posting;
+        for (size_t j = posting->len; j > 0; --j) {
+            if ((id = posting->ids[j - 1]) < search->first)
+                break;
+            shared[id - search->first]++;
+        }
+    }
+
+    /* every fuzzy match ranks the same, so the newest are kept */
+    for (size_t j = term_index.len; j > search->first; --j) {
+        id = j - 1;
+        if (shared[id - search->first] < need ||
+            strstr(term_index.lines[id], search->query))
+            continue;
+        index_search_add(search, id, RANK_FUZZY);
+        if (search->len == search->max &&
+            search->matches[search->len - 1].rank == RANK_FUZZY)
+            break;
+    }
+
+    ash_free(shared);
+}
+
+size_t ash_term_index_search(const char *query, const char **matches,
+                             size_t max)
+{
+    struct index_slot *slot;
+    struct index_posting *posting = NULL;
+    struct index_search search;
+    uint32_t pair;
+
+    if (!query || !*query || max == 0 || term_index.len == 0)
+        return 0;
+
+    search.query = query;
+    search.qlen = strlen(query);
+    search.first = index_first(&term_index);
+    search.best = RANK_PREFIX;
+    search.matches = ash_alloc(max * sizeof *search.matches);
+    search.len = 0;
+    search.max = max;
+
+    if (search.qlen < 2) {
+        for (size_t id = term_index.len; id > search.first; --id) {
+            if (!(term_index.masks[id - 1] & index_bit(query[0])))
+                continue;
+            index_search_verify(&search, id - 1);
+            if (index_search_done(&search))
+                break;
+        }
+    } else if (search.qlen == 2) {
+        pair = index_gram((const char []) { query[0], query[1], 0 });
+        index_search_pair(&search, INDEX_START | pair);
+        search.best = RANK_WORD;
+        if (!index_search_done(&search))
+            index_search_pair(&search, pair);
+    } else {
+        /* only the lines holding the rarest trigram can match */
+        for (size_t i = 0; i + 3 <= search.qlen; ++i) {
+            if (!(slot = index_find(&term_index, index_gram(&query[i])))) {
+                posting = NULL;
+                break;
+            }
+            if (!posting || slot->posting.len < posting->len)
+                posting = &slot->posting;
+        }
+
+        if (posting) {
+            slot = index_find(&term_index, INDEX_START | index_gram(query));
+            if (slot)
+                index_search_both(&search, &slot->posting, posting);
+            search.best = RANK_WORD;
+            if (!index_search_done(&search))
+                index_search_posting(&search, posting);
+        }
+
+        if (search.len < max)
+            index_search_fuzzy(&search);
+    }
+
+    for (size_t i = 0; i < search.len; ++i)
+        matches[i] = term_index.lines[search.matches[i].id];
+
+    max = search.len;
+    ash_free(search.matches);
+    return max;
+}
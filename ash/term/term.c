@@ -16,37 +16,443 @@
 
 #include <assert.h>
 #include <editline/readline.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "ash/ash.h"
+#include "ash/env.h"
+#include "ash/io.h"
 #include "ash/mem.h"
 #include "ash/ops.h"
 #include "ash/type.h"
 #include "ash/unit.h"
+#include "ash/term/index.h"
 #include "ash/term/term.h"
 
+#ifdef ASH_PLATFORM_POSIX
+    #include <fcntl.h>
+    #include <sys/file.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
 #define ASH_HISTORY_NAME "~.ash_history"
+/* the lines of history kept unless set otherwise */
 #define ASH_HISTORY_SIZE 500
+/* the most lines the history may be set to keep */
+#define ASH_HISTORY_SIZE_MAX (1 << 24)
 
-void ash_term_clear(void)
-{
-    clear_history();
-}
+/* the size of each block read from the end of the history file */
+#define ASH_HISTORY_BLOCK 4096
+
+/* the first line of a file written by the line editor */
+#define ASH_HISTORY_HEADER "_HiStOrY_V2_\n"
+
+#define ASH_HISTORY_FLAGS (O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC)
+
+/*
+the history file is appended to a line at a time, so that
+concurrent shells add to rather than replace it, and only its
+tail is read at startup. once the file has grown to twice the
+size of the lines kept it is replaced by a copy of its tail;
+a shell holding the file it replaced opens the new one when
+it next takes the lock
+*/
+struct term_history {
+    char *name;
+    int fd;
+    /* the number of lines kept */
+    size_t size;
+    /* lines appended since the file was last checked */
+    size_t appended;
+};
+
+static struct term_history hist = {
+    .name = NULL,
+    .fd = -1,
+    .size = ASH_HISTORY_SIZE,
+    .appended = 0
+};
 
-static inline const char *history(void)
+/* if readline and the history have been set up */
+static bool term_ready = false;
+
+static inline char *history(void)
 {
     const char *name;
+
+    if ((name = getenv(ASH_HISTORY_ENV)) && *name)
+        return (char *) ash_strcpy(name);
+
     name = ash_ops_tilde(ASH_HISTORY_NAME);
     assert(name);
-    return name;
+    return (char *) name;
 }
 
-static void ash_term_clean(void)
+static size_t history_size(void)
 {
-    const char *name;
-    name = history();
-    write_history(name);
+    const char *value;
+    char *end;
+    unsigned long size;
+
+    if (!(value = getenv(ASH_HISTORY_SIZE_ENV)) || !*value)
+        return ASH_HISTORY_SIZE;
+
+    errno = 0;
+    size = strtoul(value, &end, 10);
+    if (errno || *end || size == 0 || size > ASH_HISTORY_SIZE_MAX)
+        return ASH_HISTORY_SIZE;
+    return size;
+}
+
+/* take the lock on the history file, reopening it if it was replaced */
+static bool history_lock(int op)
+{
+    struct stat st, named;
+    int fd;
+
+    for (;;) {
+        if (hist.fd == -1 || flock(hist.fd, op) == -1)
+            return false;
+
+        if (fstat(hist.fd, &st) == -1 || stat(hist.name, &named) == -1 ||
+            (st.st_dev == named.st_dev && st.st_ino == named.st_ino))
+            return true;
+
+        if ((fd = open(hist.name, ASH_HISTORY_FLAGS, 0600)) == -1) {
+            flock(hist.fd, LOCK_UN);
+            return false;
+        }
+        close(hist.fd);
+        hist.fd = fd;
+    }
+}
+
+/*
+read the last `count` lines of the history file by reading
+blocks backwards from its end; `len` is set to their size
+*/
+static char *history_tail(int fd, size_t count, size_t *len)
+{
+    struct stat st;
+    char *buf = NULL;
+    size_t size = 0, lines = 0, start = 0;
+    off_t pos;
+    ssize_t n;
+
+    *len = 0;
+    if (fstat(fd, &st) == -1 || st.st_size == 0)
+        return NULL;
+
+    pos = st.st_size;
+    while (pos > 0 && !start) {
+        size_t block = (pos > ASH_HISTORY_BLOCK) ? ASH_HISTORY_BLOCK: pos;
+        pos -= block;
+
+        buf = (buf) ? ash_realloc(buf, size + block): ash_alloc(block);
+        memmove(buf + block, buf, size);
+        if ((n = pread(fd, buf, block, pos)) != (ssize_t) block) {
+            ash_free(buf);
+            return NULL;
+        }
+        size += block;
+
+        /* the newline ending the final line does not begin one */
+        for (size_t i = block; i > 0 && !start; --i) {
+            if (buf[i - 1] == '\n' && pos + (off_t) i != st.st_size &&
+                ++lines >= count)
+                start = i;
+        }
+    }
+
+    *len = size - start;
+    memmove(buf, buf + start, *len);
+    return buf;
+}
+
+/* add each line of the tail to the in-memory history */
+static void history_load(const char *tail, size_t len)
+{
+    const char *end;
+    char *line;
+    size_t n;
+
+    while (len > 0) {
+        if (!(end = memchr(tail, '\n', len)))
+            end = tail + len;
+
+        if ((n = end - tail) > 0) {
+            line = ash_alloc(n + 1);
+            memcpy(line, tail, n);
+            line[n] = '\0';
+            add_history(line);
+            ash_term_index_add(line);
+            ash_free(line);
+        }
+
+        n = (end < tail + len) ? n + 1: n;
+        tail += n;
+        len -= n;
+    }
+}
+
+static bool history_write(int fd, const char *s, size_t len)
+{
+    ssize_t n;
+
+    while (len > 0) {
+        if ((n = write(fd, s, len)) == -1) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        s += n;
+        len -= n;
+    }
+    return true;
+}
+
+/*
+replace the locked history file with `s`, written in full to a
+temporary file first so that a failure leaves it unchanged
+*/
+static void history_replace(const char *s, size_t len)
+{
+    char *tmp;
+    int fd;
+    bool done;
+
+    tmp = (char *) ash_strcat(hist.name, ".XXXXXX");
+    if ((fd = mkstemp(tmp)) == -1) {
+        ash_free(tmp);
+        return;
+    }
+
+    done = history_write(fd, s, len);
+    done = (close(fd) == 0) && done;
+    if (!done || rename(tmp, hist.name) == -1) {
+        unlink(tmp);
+        ash_free(tmp);
+        return;
+    }
+    ash_free(tmp);
+
+    /* closing the replaced file releases its lock */
+    if ((fd = open(hist.name, ASH_HISTORY_FLAGS, 0600)) != -1) {
+        close(hist.fd);
+        hist.fd = fd;
+    }
+}
+
+/*
+rewrite the history file with only its last lines when it
+has grown beyond twice their size. the file is locked so that
+the lines other shells append are not lost
+*/
+static void history_compact(void)
+{
+    struct stat st;
+    size_t len;
+    char *tail;
+
+    if (!history_lock(LOCK_EX))
+        return;
+
+    if (fstat(hist.fd, &st) == 0 &&
+        (tail = history_tail(hist.fd, hist.size, &len))) {
+        if ((size_t) st.st_size > len * 2)
+            history_replace(tail, len);
+        ash_free(tail);
+    }
+
+    flock(hist.fd, LOCK_UN);
+}
+
+/*
+decode a line escaped by strvis(3) as the line editor writes
+them: octal, control and meta characters and C escapes
+*/
+static size_t history_unvis(char *dst, const char *s)
+{
+    char *d = dst;
+    unsigned char c, meta;
+
+    while (*s) {
+        if (*s != '\\' || !s[1]) {
+            *d++ = *s++;
+            continue;
+        }
+        ++s;
+
+        if (*s >= '0' && *s <= '7') {
+            c = 0;
+            for (int i = 0; i < 3 && *s >= '0' && *s <= '7'; ++i)
+                c = (c << 3) | (*s++ - '0');
+            *d++ = (char) c;
+            continue;
+        }
+
+        meta = 0;
+        if (s[0] == 'M' && s[1] == '-' && s[2]) {
+            *d++ = (char) (0200 | (unsigned char) s[2]);
+            s += 3;
+            continue;
+        } else if (s[0] == 'M' && s[1] == '^' && s[2]) {
+            meta = 0200;
+            ++s;
+        }
+
+        if (s[0] == '^' && s[1]) {
+            c = (s[1] == '?') ? 0177: (s[1] & 037);
+            *d++ = (char) (meta | c);
+            s += 2;
+            continue;
+        }
+
+        switch (*s) {
+            case 'n': c = '\n'; break;
+            case 't': c = '\t'; break;
+            case 'r': c = '\r'; break;
+            case 'b': c = '\b'; break;
+            case 'a': c = '\a'; break;
+            case 'v': c = '\v'; break;
+            case 'f': c = '\f'; break;
+            case 's': c = ' '; break;
+            case 'E': c = 033; break;
+            default: c = *s; break;
+        }
+        *d++ = (char) c;
+        ++s;
+    }
+    return d - dst;
+}
+
+static inline bool history_header(void)
+{
+    char head[sizeof ASH_HISTORY_HEADER - 1];
+
+    return (pread(hist.fd, head, sizeof head, 0) == (ssize_t) sizeof head &&
+            memcmp(head, ASH_HISTORY_HEADER, sizeof head) == 0);
+}
+
+/*
+a history file written by the line editor begins with a header
+and escapes each line; it is rewritten a line at a time, once,
+while locked
+*/
+static void history_convert(void)
+{
+    struct stat st;
+    char *file, *buf, *line, *end;
+    size_t len = 0, n;
+
+    if (!history_header() || !history_lock(LOCK_EX))
+        return;
+
+    /* another shell may have converted it first */
+    if (history_header() && fstat(hist.fd, &st) == 0) {
+        file = ash_alloc(st.st_size + 1);
+        if (pread(hist.fd, file, st.st_size, 0) == (ssize_t) st.st_size) {
+            file[st.st_size] = '\0';
+            /* a decoded line is never longer than its escaped form */
+            buf = ash_alloc(st.st_size + 1);
+
+            for (line = file + strlen(ASH_HISTORY_HEADER); *line; line = end) {
+                if ((end = strchr(line, '\n')))
+                    *end++ = '\0';
+                else
+                    end = line + strlen(line);
+
+                /* a line holding a newline cannot be kept a line at a time */
+                n = history_unvis(buf + len, line);
+                if (n > 0 && !memchr(buf + len, '\n', n)) {
+                    buf[len + n] = '\n';
+                    len += n + 1;
+                }
+            }
+
+            history_replace(buf, len);
+            ash_free(buf);
+        }
+        ash_free(file);
+    }
+
+    flock(hist.fd, LOCK_UN);
+}
+
+static void history_append(const char *line)
+{
+    size_t len;
+    char *s;
+
+    if (hist.fd == -1)
+        return;
+
+    len = strlen(line);
+    s = ash_alloc(len + 1);
+    memcpy(s, line, len);
+    s[len] = '\n';
+
+    /* a single write to an appending descriptor is not interleaved */
+    if (history_lock(LOCK_SH)) {
+        history_write(hist.fd, s, len + 1);
+        flock(hist.fd, LOCK_UN);
+    }
+    ash_free(s);
+
+    if (++hist.appended >= hist.size) {
+        hist.appended = 0;
+        history_compact();
+    }
+}
+
+static void history_open(void)
+{
+    char *tail;
+    size_t len;
+
+    hist.name = history();
+    hist.fd = open(hist.name, ASH_HISTORY_FLAGS, 0600);
+    if (hist.fd == -1)
+        return;
+
+    history_convert();
+    if ((tail = history_tail(hist.fd, hist.size, &len))) {
+        history_load(tail, len);
+        ash_free(tail);
+    }
+    history_compact();
+}
+
+/*
+readline and the history are set up when the terminal is first
+used rather than at startup, so that scripts and commands that
+never read from it do not load the history file
+*/
+void ash_term_open(void)
+{
+    if (term_ready)
+        return;
+    term_ready = true;
+
+    rl_initialize();
+    hist.size = history_size();
+    stifle_history((int) hist.size);
+    ash_term_index_limit(hist.size);
+    history_open();
+}
+
+void ash_term_clear(void)
+{
+    ash_term_open();
+    clear_history();
+    ash_term_index_clear();
+    if (history_lock(LOCK_EX)) {
+        if (ftruncate(hist.fd, 0) == -1)
+            ash_print_errno("history");
+        flock(hist.fd, LOCK_UN);
+    }
 }
 
 static inline bool
@@ -54,6 +460,8 @@ ash_term_hist(const char *line)
 {
     if (line && (*line)) {
         add_history(line);
+        ash_term_index_add(line);
+        history_append(line);
         return true;
     }
     return false;
@@ -76,6 +484,7 @@ const char *ash_term_get(const char *prompt)
 {
     char *input = NULL, *s;
 
+    ash_term_open();
     if ((input = readline(prompt))) {
         ash_term_hist(input);
 
@@ -91,6 +500,7 @@ const char *ash_term_get_raw(const char *prompt)
 {
     char *input = NULL;
 
+    ash_term_open();
     if ((input = readline(prompt)))
         ash_term_hist(input);
     return input;
@@ -101,21 +511,19 @@ const char *ash_term_get_default(void)
     return ash_term_get(NULL);
 }
 
-static void init(void)
-{
-    rl_initialize();
-
-    const char *name;
-    name = history();
-    read_history(name);
-}
-
 static void destroy(void)
 {
-    ash_term_clean();
+    if (hist.fd != -1) {
+        close(hist.fd);
+        hist.fd = -1;
+    }
+    if (hist.name) {
+        ash_free(hist.name);
+        hist.name = NULL;
+    }
 }
 
 const struct ash_unit_module ash_module_term = {
-    .init = init,
+    .init = NULL,
     .destroy = destroy
 };
@@ -0,0 +1,348 @@
+/* Copyright 2018 eomain
+   this program is licensed under the 2-clause BSD license
+   see COPYING for the full license info
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "ash/bool.h"
+#include "ash/env.h"
+#include "ash/int.h"
+#include "ash/io.h"
+#include "ash/mem.h"
+#include "ash/obj.h"
+#include "ash/str.h"
+#include "ash/type.h"
+#include "ash/type/bytes.h"
+#include "ash/util/rc.h"
+
+#ifdef ASH_PLATFORM_POSIX
+    #include <sys/stat.h>
+    #include <sys/types.h>
+    #include <unistd.h>
+#endif
+
+#define ASH_BYTES_TYPENAME "bytes"
+
+/* initial size of the buffer when reading from a stream */
+#define BYTES_BUFSIZ 65536
+
+/* storage shared between bytes and the slices taken from them */
+struct bytes_buffer {
+    char *data;
+    size_t size;
+};
+
+/*
+a view of `len` bytes at `offset` within a shared buffer;
+slices only take another reference to the buffer
+*/
+struct ash_bytes {
+    struct ash_obj obj;
+    struct rc *buffer;
+    size_t offset;
+    size_t len;
+    struct ash_obj *byte;
+    struct ash_obj *string;
+};
+
+static void bytes_buffer_destroy(void *ptr)
+{
+    struct bytes_buffer *buffer;
+    buffer = ptr;
+    ash_free(buffer->data);
+    ash_free(buffer);
+}
+
+static inline const char *
+data(struct ash_bytes *bytes)
+{
+    struct bytes_buffer *buffer;
+    buffer = rc_get(bytes->buffer);
+    return buffer->data + bytes->offset;
+}
+
+static struct ash_obj *
+bytes_eq(struct ash_obj *a, struct ash_obj *b)
+{
+    struct ash_bytes *ab, *bb;
+    ab = (struct ash_bytes *) a;
+    bb = (struct ash_bytes *) b;
+    bool eq = (ab->len == bb->len && !memcmp(data(ab), data(bb), ab->len));
+    return ash_bool_from(eq);
+}
+
+static struct ash_obj *
+bytes_ne(struct ash_obj *a, struct ash_obj *b)
+{
+    struct ash_bytes *ab, *bb;
+    ab = (struct ash_bytes *) a;
+    bb = (struct ash_bytes *) b;
+    bool ne = (ab->len != bb->len || memcmp(data(ab), data(bb), ab->len));
+    return ash_bool_from(ne);
+}
+
+static struct ash_obj *
+bytes_add(struct ash_obj *a, struct ash_obj *b)
+{
+    struct ash_bytes *ab, *bb;
+    char *value;
+    ab = (struct ash_bytes *) a;
+    bb = (struct ash_bytes *) b;
+    value = ash_alloc(ab->len + bb->len + 1);
+    memcpy(value, data(ab), ab->len);
+    memcpy(value + ab->len, data(bb), bb->len);
+    return ash_bytes_new(value, ab->len + bb->len);
+}
+
+static struct ash_obj *
+boolean(struct ash_obj *obj)
+{
+    struct ash_bytes *bytes;
+    bytes = (struct ash_bytes *) obj;
+    return ash_bool_from(bytes->len > 0);
+}
+
+/* the bytes as text, kept for the lifetime of the bytes */
+static struct ash_obj *
+string(struct ash_obj *obj)
+{
+    struct ash_bytes *bytes;
+    char *value;
+    bytes = (struct ash_bytes *) obj;
+    if (!bytes->string) {
+        value = ash_alloc(bytes->len + 1);
+        memcpy(value, data(bytes), bytes->len);
+        value[bytes->len] = '\0';
+        bytes->string = ash_str_from_len(value, bytes->len);
+    }
+    return bytes->string;
+}
+
+static bool match(struct ash_obj *obj, struct ash_obj *m)
+{
+    struct ash_bytes *ab, *bb;
+    if (!ash_obj_type_eq(obj, m))
+        return false;
+    ab = (struct ash_bytes *) obj;
+    bb = (struct ash_bytes *) m;
+    return (ab->len == bb->len && !memcmp(data(ab), data(bb), ab->len));
+}
+
+/* iterate the value of each byte */
+static struct option iter(struct ash_obj *obj, size_t pos)
+{
+    struct option opt;
+    struct ash_bytes *bytes;
+    bytes = (struct ash_bytes *) obj;
+
+    if (pos < bytes->len) {
+        if (!bytes->byte) {
+            bytes->byte = ash_int_new();
+            bytes->byte->reused = true;
+        }
+        ash_int_set(bytes->byte, (unsigned char) data(bytes)[pos]);
+        ash_obj_inc_rc(bytes->byte);
+        option_some(&opt, bytes->byte);
+        return opt;
+    }
+
+    option_none(&opt);
+    return opt;
+}
+
+static void dealloc(struct ash_obj *obj)
+{
+    struct ash_bytes *bytes;
+    bytes = (struct ash_bytes *) obj;
+    rc_destroy(bytes->buffer);
+    ash_obj_dec_rc(bytes->byte);
+    ash_obj_dec_rc(bytes->string);
+}
+
+static const char *name()
+{
+    return ASH_BYTES_TYPENAME;
+}
+
+static struct ash_base base = {
+    .ops = {
+        .eq = bytes_eq,
+        .ne = bytes_ne,
+        .add = bytes_add
+    },
+
+    .into = {
+        .boolean = boolean,
+        .string  = string
+    },
+
+    .util = {
+        .match = match
+    },
+
+    .iter = iter,
+    .dealloc = dealloc,
+    .name = name
+};
+
+static struct ash_obj *bytes_new(struct rc *buffer, size_t offset, size_t len)
+{
+    struct ash_bytes *bytes;
+    bytes = ash_alloc(sizeof *bytes);
+    bytes->buffer = buffer;
+    bytes->offset = offset;
+    bytes->len = len;
+    bytes->byte = NULL;
+    bytes->string = NULL;
+
+    struct ash_obj *obj;
+    obj = (struct ash_obj *) bytes;
+    ash_obj_init(obj, &base);
+    return obj;
+}
+
+struct ash_obj *ash_bytes_new(char *value, size_t len)
+{
+    struct bytes_buffer *buffer;
+    buffer = ash_alloc(sizeof *buffer);
+    buffer->data = value;
+    buffer->size = len;
+    return bytes_new(rc_new(buffer, bytes_buffer_destroy), 0, len);
+}
+
+struct ash_obj *ash_bytes_from(const char *value, size_t len)
+{
+    char *copy;
+    copy = ash_alloc(len + 1);
+    memcpy(copy, value, len);
+    return ash_bytes_new(copy, len);
+}
+
+struct ash_obj *ash_bytes_slice(struct ash_obj *obj, size_t offset, size_t len)
+{
+    if (ash_base_derived(&base, obj)) {
+        struct ash_bytes *bytes;
+        bytes = (struct ash_bytes *) obj;
+        if (offset > bytes->len)
+            offset = bytes->len;
+        if (len > bytes->len - offset)
+            len = bytes->len - offset;
+        return bytes_new(rc_clone(bytes->buffer), bytes->offset + offset, len);
+    }
+
+    return NULL;
+}
+
+const char *ash_bytes_get(struct ash_obj *obj)
+{
+    if (ash_base_derived(&base, obj))
+        return data((struct ash_bytes *) obj);
+
+    return NULL;
+}
+
+size_t ash_bytes_len(struct ash_obj *obj)
+{
+    if (ash_base_derived(&base, obj)) {
+        struct ash_bytes *bytes;
+        bytes = (struct ash_bytes *) obj;
+        return bytes->len;
+    }
+
+    return 0;
+}
+
+#ifdef ASH_PLATFORM_POSIX
+
+/* the number of bytes left to read from a regular file, otherwise 0 */
+static size_t bytes_remaining(int fd)
+{
+    struct stat st;
+    off_t pos;
+
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode))
+        return 0;
+    if ((pos = lseek(fd, 0, SEEK_CUR)) == -1 || pos >= st.st_size)
+        return 0;
+    return st.st_size - pos;
+}
+
+struct ash_obj *ash_bytes_read(int fd, isize count)
+{
+    size_t size, len = 0, want;
+    ssize_t n;
+    char *value;
+
+    /*
+    read a regular file straight into a buffer of its size,
+    with a spare byte so that its end is seen without growing
+    */
+    if ((size = bytes_remaining(fd)) > 0)
+        size++;
+    else
+        size = BYTES_BUFSIZ;
+    if (count >= 0 && (size_t) count < size)
+        size = count;
+    value = ash_alloc(size + 1);
+
+    while (count < 0 || len < (size_t) count) {
+        if (len == size) {
+            size *= 2;
+            if (count >= 0 && (size_t) count < size)
+                size = count;
+            value = ash_realloc(value, size + 1);
+        }
+
+        want = size - len;
+        do {
+            n = read(fd, value + len, want);
+        } while (n == -1 && errno == EINTR);
+
+        if (n == -1 && len == 0) {
+            ash_free(value);
+            return NULL;
+        }
+        if (n <= 0)
+            break;
+        len += n;
+    }
+
+    if (len + 1 < size / 2)
+        value = ash_realloc(value, len + 1);
+    return ash_bytes_new(value, len);
+}
+
+bool ash_bytes_write(int fd, const char *value, size_t len)
+{
+    ssize_t n;
+
+    /* keep the order of anything already written by the shell */
+    ash_flush();
+    while (len > 0) {
+        if ((n = write(fd, value, len)) == -1) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        value += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+#endif
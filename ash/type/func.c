@@ -22,7 +22,9 @@
 #include "ash/mem.h"
 #include "ash/obj.h"
 #include "ash/ops.h"
+#include "ash/prof.h"
 #include "ash/str.h"
+#include "ash/trace.h"
 #include "ash/var.h"
 #include "ash/ffi/ffi.h"
 #include "ash/lang/ast.h"
@@ -194,12 +196,22 @@ ash_func_exec(struct ash_obj *obj, struct ash_runtime_env *renv,
 {
     if (ash_base_derived(&base, obj)) {
         struct ash_func *func;
+        struct ash_obj *ret;
+        struct ash_prof_frame frame;
+        const char *name;
+        uint64_t start;
         func = (struct ash_func *) obj;
+        name = func->name ? func->name: ASH_FUNC_ANONYMOUS;
 
+        start = ash_trace_now();
+        ash_prof_push(&frame, name);
         if (func->ffi)
-            return ash_func_exec_ffi(func, args);
+            ret = ash_func_exec_ffi(func, args);
         else
-            return ash_func_exce_native(func, renv, args);
+            ret = ash_func_exce_native(func, renv, args);
+        ash_prof_pop(&frame);
+        ash_trace(ASH_TRACE_FUNC, name, start, ASH_TRACE_NO_STATUS, 0);
+        return ret;
     }
 
     return NULL;
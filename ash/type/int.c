@@ -163,6 +163,11 @@ static const char *name()
     return ASH_INT_TYPENAME;
 }
 
+static struct ash_obj *clone(struct ash_obj *obj)
+{
+    return ash_int_from(ash_int_get(obj));
+}
+
 static struct ash_obj *
 string(struct ash_obj *obj)
 {
@@ -205,7 +210,8 @@ static struct ash_base base = {
 
     .iter = ash_base_iter_default,
     .dealloc = NULL,
-    .name = name
+    .name = name,
+    .clone = clone
 };
 
 struct ash_base *ash_int_base(void)
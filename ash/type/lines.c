@@ -0,0 +1,172 @@
+/* Copyright 2018 eomain
+   this program is licensed under the 2-clause BSD license
+   see COPYING for the full license info
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stddef.h>
+#include <string.h>
+
+#include "ash/env.h"
+#include "ash/io.h"
+#include "ash/mem.h"
+#include "ash/obj.h"
+#include "ash/str.h"
+#include "ash/type.h"
+#include "ash/type/lines.h"
+#include "ash/util/readbuf.h"
+
+#ifdef ASH_PLATFORM_POSIX
+    #include <sys/types.h>
+    #include <sys/wait.h>
+    #include <unistd.h>
+#endif
+
+#define ASH_LINES_TYPENAME "lines"
+
+/* initial size of the read buffer */
+#define LINES_BUFSIZ 65536
+
+/*
+a stream of lines read lazily from a descriptor; only the
+current line is kept, in one string reused for every line
+*/
+struct ash_lines {
+    struct ash_obj obj;
+    int fd;
+    int pid;
+    struct readbuf input;
+    size_t count;
+    struct ash_obj *line;
+};
+
+static const char *name()
+{
+    return ASH_LINES_TYPENAME;
+}
+
+static void lines_close(struct ash_lines *lines)
+{
+    if (lines->fd != -1) {
+        close(lines->fd);
+        lines->fd = -1;
+    }
+
+    if (lines->pid > 0) {
+        waitpid(lines->pid, NULL, 0);
+        lines->pid = -1;
+    }
+
+    readbuf_destroy(&lines->input);
+}
+
+/* read more input into the buffer, returns the number of bytes read */
+static size_t lines_fill(struct ash_lines *lines)
+{
+    /* the producer may block on output from the loop body */
+    ash_flush();
+    return readbuf_fill(&lines->input, lines->fd, 0);
+}
+
+static bool lines_read(struct ash_lines *lines)
+{
+    struct readbuf *input = &lines->input;
+    char *start, *end, *line;
+    size_t len;
+
+    if (!input->buf)
+        return false;
+
+    for (;;) {
+        start = input->buf + input->head;
+        len = input->tail - input->head;
+
+        if ((end = memchr(start, '\n', len))) {
+            len = end - start;
+            input->head += len + 1;
+            break;
+        }
+
+        if (lines_fill(lines) == 0) {
+            if (len == 0) {
+                lines_close(lines);
+                return false;
+            }
+            /* last line without a newline; the fill may have moved it */
+            start = input->buf + input->head;
+            input->head = input->tail;
+            break;
+        }
+    }
+
+    line = ash_alloc(len + 1);
+    memcpy(line, start, len);
+    line[len] = '\0';
+    ash_str_set(lines->line, line);
+    lines->count++;
+    return true;
+}
+
+static struct option iter(struct ash_obj *obj, size_t pos)
+{
+    struct option opt;
+    struct ash_lines *lines;
+    lines = (struct ash_lines *) obj;
+
+    /* the current line may be requested more than once */
+    if ((lines->count > 0 && pos == lines->count - 1) ||
+        (pos == lines->count && lines_read(lines))) {
+        ash_obj_inc_rc(lines->line);
+        option_some(&opt, lines->line);
+        return opt;
+    }
+
+    option_none(&opt);
+    return opt;
+}
+
+static void dealloc(struct ash_obj *obj)
+{
+    struct ash_lines *lines;
+    lines = (struct ash_lines *) obj;
+    lines_close(lines);
+}
+
+static struct ash_base base = {
+    .iter = iter,
+    .dealloc = dealloc,
+    .name = name
+};
+
+struct ash_obj *ash_lines_from(int fd, int pid)
+{
+    struct ash_lines *lines;
+    lines = ash_alloc(sizeof *lines);
+    lines->fd = fd;
+    lines->pid = pid;
+    readbuf_init(&lines->input, LINES_BUFSIZ);
+    lines->count = 0;
+    lines->line = ash_str_new();
+    lines->line->reused = true;
+
+    struct ash_obj *obj;
+    obj = (struct ash_obj *) lines;
+    ash_obj_init(obj, &base);
+    return obj;
+}
+
+void ash_lines_close(struct ash_obj *obj)
+{
+    if (ash_base_derived(&base, obj))
+        lines_close((struct ash_lines *) obj);
+}
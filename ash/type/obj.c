@@ -50,6 +50,7 @@ ash_obj_init(struct ash_obj *obj, struct ash_base *base)
     obj->ref = NULL;
     obj->bound = false;
     obj->mutable = true;
+    obj->reused = false;
     obj->rc = ASH_OBJ_REF_INIT;
     obj->string = NULL;
 }
@@ -214,6 +215,23 @@ bool ash_obj_has_bind(struct ash_obj *obj)
     return obj->bound;
 }
 
+/*
+an iterator may yield the same object for each item, changing
+it in place; one that is kept beyond the iteration is copied
+*/
+struct ash_obj *
+ash_obj_keep(struct ash_obj *obj)
+{
+    struct ash_obj *copy;
+
+    if (ash_obj_nil(obj) || !obj->reused || !obj->base->clone)
+        return obj;
+
+    copy = obj->base->clone(obj);
+    ash_obj_dec_rc(obj);
+    return copy;
+}
+
 usize
 ash_obj_get_rc(struct ash_obj *obj)
 {
@@ -110,6 +110,7 @@ struct ash_obj *ash_range_new(void)
     struct ash_range *range;
     range = ash_alloc(sizeof *range);
     range->index = ash_int_new();
+    range->index->reused = true;
     range->start = 0;
     range->end = 0;
     range->inclusive = false;
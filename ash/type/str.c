@@ -105,6 +105,11 @@ static const char *name()
     return ASH_STR_TYPENAME;
 }
 
+static struct ash_obj *clone(struct ash_obj *obj)
+{
+    return ash_str_clone_from(ash_str_get(obj));
+}
+
 static struct ash_obj *string(struct ash_obj *obj)
 {
     return obj;
@@ -117,8 +122,10 @@ static struct option iter(struct ash_obj *obj, size_t pos)
     struct ash_string *string;
     string = (struct ash_string *) obj;
     if (pos < string->len) {
-        if (!string->character)
+        if (!string->character) {
             string->character = ash_str_new();
+            string->character->reused = true;
+        }
         char c[] = { string->data[pos], '\0' };
         ash_str_set(string->character, ash_strcpy(c));
         ash_obj_inc_rc(string->character);
@@ -162,7 +169,8 @@ static struct ash_base base = {
 
     .iter = iter,
     .dealloc = dealloc,
-    .name = name
+    .name = name,
+    .clone = clone
 };
 
 struct ash_obj *ash_str_new(void)
@@ -209,3 +217,26 @@ struct ash_obj *ash_str_from(const char *value)
     ash_str_set(obj, value);
     return obj;
 }
+
+/* create a string from one of a known length, taking ownership */
+struct ash_obj *ash_str_from_len(const char *value, size_t len)
+{
+    struct ash_string *as;
+    struct ash_obj *obj;
+    obj = ash_str_new();
+    as = (struct ash_string *) obj;
+    as->data = value;
+    as->len = len;
+    return obj;
+}
+
+size_t ash_str_len(struct ash_obj *obj)
+{
+    if (ash_base_derived(&base, obj)) {
+        struct ash_string *as;
+        as = (struct ash_string *) obj;
+        return as->len;
+    }
+
+    return 0;
+}
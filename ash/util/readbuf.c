@@ -0,0 +1,79 @@
+/* Copyright 2019 eomain
+   this program is licensed under the 2-clause BSD license
+   see COPYING for the full license info
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <string.h>
+
+#include "ash/env.h"
+#include "ash/mem.h"
+#include "ash/util/readbuf.h"
+
+#ifdef ASH_PLATFORM_POSIX
+    #include <unistd.h>
+#endif
+
+void readbuf_init(struct readbuf *rb, size_t size)
+{
+    rb->buf = ash_alloc(size);
+    rb->size = size;
+    rb->head = 0;
+    rb->tail = 0;
+}
+
+void readbuf_destroy(struct readbuf *rb)
+{
+    if (rb->buf)
+        ash_free(rb->buf);
+    rb->buf = NULL;
+    rb->size = rb->head = rb->tail = 0;
+}
+
+/*
+read up to `max` bytes from a descriptor, or as many as fit
+when zero, after the unread input; the unread input is first
+moved to the front and the buffer doubled when it is full.
+returns the number of bytes read
+*/
+size_t readbuf_fill(struct readbuf *rb, int fd, size_t max)
+{
+    size_t len;
+    ssize_t n;
+
+    if (rb->head > 0) {
+        memmove(rb->buf, rb->buf + rb->head, rb->tail - rb->head);
+        rb->tail -= rb->head;
+        rb->head = 0;
+    }
+
+    if (rb->tail == rb->size) {
+        rb->size *= 2;
+        rb->buf = ash_realloc(rb->buf, rb->size);
+    }
+
+    len = rb->size - rb->tail;
+    if (max && max < len)
+        len = max;
+
+    do {
+        n = read(fd, rb->buf + rb->tail, len);
+    } while (n == -1 && errno == EINTR);
+
+    if (n <= 0)
+        return 0;
+
+    rb->tail += n;
+    return n;
+}
@@ -0,0 +1,141 @@
+/* Copyright 2018 eomain
+   this program is licensed under the 2-clause BSD license
+   see COPYING for the full license info
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*
+history search: fills the index with a synthetic history and
+times a spread of queries, the way `history -s` issues them,
+reporting the mean of their best times and the slowest query
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ash/mem.h"
+#include "ash/ops.h"
+#include "ash/term/index.h"
+
+#define BENCH_LINES 100000
+#define BENCH_RUNS 20
+#define BENCH_MATCHES 10
+
+/* the rest of the shell is not linked */
+void ash_abort(const char *msg)
+{
+    fprintf(stderr, "bench: %s\n", msg);
+    exit(1);
+}
+
+const char *ash_strcpy(const char *s)
+{
+    return strcpy(ash_alloc(strlen(s) + 1), s);
+}
+
+static const char *commands[] = {
+    "git commit -m \"fix %s in %s\"",
+    "git checkout -b %s-%s",
+    "make -j8 %s %s",
+    "ls -la /usr/share/%s/%s",
+    "ssh %s@%s.example.org",
+    "grep -rn %s src/%s",
+    "docker run --rm -it %s/%s",
+    "cd ~/work/%s/%s",
+    "vim %s/%s.c",
+    "curl -s https://%s.example.org/%s | jq .",
+};
+
+static const char *words[] = {
+    "parser", "lexer", "runtime", "history", "index", "term", "ffi",
+    "cache", "alloc", "lines", "bytes", "range", "profile", "module",
+    "debian", "alpine", "build", "release", "staging", "backup",
+    "alice", "bob", "server", "worker", "deploy", "config", "doc"
+};
+
+/* spread across prefixes, words, substrings, fuzzy and missing */
+static const char *queries[] = {
+    "g", "|", "ma", "git", "git commit", "docker run", "parser", "arser",
+    "ssh bob@", "src/ffi", "release-", "jq", "ocnfig",
+    "git chekcout", "no such command"
+};
+
+#define countof(a) (sizeof (a) / sizeof *(a))
+
+static double bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static void bench_fill(size_t lines)
+{
+    unsigned long seed = 1;
+    char line[256];
+    const char *a, *b;
+
+    for (size_t i = 0; i < lines; ++i) {
+        seed = (seed * 1103515245 + 12345) & 0x7fffffff;
+        a = words[(seed >> 4) % countof(words)];
+        b = words[(seed >> 12) % countof(words)];
+        snprintf(line, sizeof line,
+                 commands[(seed >> 20) % countof(commands)], a, b);
+        ash_term_index_add(line);
+    }
+}
+
+int main(int argc, const char *argv[])
+{
+    const char *matches[BENCH_MATCHES];
+    size_t lines = BENCH_LINES, found = 0, matched = 0;
+    double start, elapsed, fill, best, total = 0, worst = 0;
+    const char *slowest = queries[0];
+    int runs = BENCH_RUNS;
+
+    if (argc > 1)
+        lines = strtoul(argv[1], NULL, 10);
+    if (argc > 2)
+        runs = atoi(argv[2]);
+
+    ash_term_index_limit(lines);
+    start = bench_now();
+    bench_fill(lines);
+    fill = bench_now() - start;
+
+    for (size_t i = 0; i < countof(queries); ++i) {
+        for (int j = 0; j < runs; ++j) {
+            start = bench_now();
+            found = ash_term_index_search(queries[i], matches,
+                                          BENCH_MATCHES);
+            elapsed = bench_now() - start;
+            if (j == 0 || elapsed < best)
+                best = elapsed;
+        }
+
+        total += best;
+        matched += found;
+        if (best > worst) {
+            worst = best;
+            slowest = queries[i];
+        }
+    }
+
+    printf("index lines=%zu queries=%zu matches=%zu fill_seconds=%.6f "
+           "mean_us=%.1f worst_us=%.1f worst_query=\"%s\"\n",
+           lines, countof(queries), matched, fill,
+           (total / countof(queries)) * 1e6, worst * 1e6, slowest);
+    ash_term_index_clear();
+    return 0;
+}
@@ -0,0 +1,142 @@
+/* Copyright 2018 eomain
+   this program is licensed under the 2-clause BSD license
+   see COPYING for the full license info
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+lexer throughput: scans a script repeatedly and reports the
+best rate in MB/s. without a script a synthetic one is used
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ash/mem.h"
+#include "ash/lang/lang.h"
+#include "ash/lang/lex.h"
+
+#define BENCH_RUNS 10
+#define BENCH_SIZE (8 << 20)
+
+/* the rest of the shell is not linked */
+void ash_abort(const char *msg)
+{
+    fprintf(stderr, "bench: %s\n", msg);
+    exit(1);
+}
+
+const char *ash_scan(const char *prompt)
+{
+    return NULL;
+}
+
+const char *ash_prompt_next(void)
+{
+    return NULL;
+}
+
+static const char *sample =
+    "# a sample of the statements found in scripts\n"
+    "def greet(name, greeting)\n"
+    "    let message := \"{ $greeting }, { $name }\";\n"
+    "    if [ $name = \"root\" ]\n"
+    "        echo \"welcome back\" $message;\n"
+    "    else\n"
+    "        echo $message | tr a-z A-Z > /dev/null;\n"
+    "    end\n"
+    "    return `$count + 1`;\n"
+    "end\n"
+    "\n"
+    "for i in 0 to 100\n"
+    "    let total := `$total * 2 + $i % 7`;\n"
+    "    ls -la /usr/share/doc 2> /dev/null | grep -c conf;\n"
+    "end\n";
+
+static char *bench_generate(size_t size, size_t *len)
+{
+    size_t n = strlen(sample);
+    char *text;
+
+    text = ash_alloc(size + n);
+    for (*len = 0; *len < size; *len += n)
+        memcpy(text + *len, sample, n);
+    return text;
+}
+
+static char *bench_read(const char *path, size_t *len)
+{
+    FILE *file;
+    char *text;
+    long size;
+
+    if (!(file = fopen(path, "r"))) {
+        perror(path);
+        exit(1);
+    }
+
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    text = ash_alloc(size + 1);
+    *len = fread(text, 1, size, file);
+    fclose(file);
+    return text;
+}
+
+static double bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+int main(int argc, const char *argv[])
+{
+    struct ash_tk_set set;
+    size_t len, tokens = 0, memory = 0;
+    double start, elapsed, best = 0;
+    int runs = BENCH_RUNS;
+    char *text;
+
+    if (argc > 1)
+        text = bench_read(argv[1], &len);
+    else
+        text = bench_generate(BENCH_SIZE, &len);
+    if (argc > 2)
+        runs = atoi(argv[2]);
+
+    for (int i = 0; i < runs; ++i) {
+        ash_tk_set_init(&set);
+        start = bench_now();
+        if (lex_scan_input(&set, text, len)) {
+            fprintf(stderr, "bench: scan error\n");
+            return 1;
+        }
+        elapsed = bench_now() - start;
+        if (i == 0 || elapsed < best)
+            best = elapsed;
+
+        tokens = set.count;
+        memory = set.size * sizeof *set.tokens;
+        ash_tk_set_destroy(&set);
+    }
+
+    printf("lex bytes=%zu tokens=%zu token_bytes=%zu seconds=%.6f "
+           "mb_per_s=%.1f\n", len, tokens, memory, best,
+           (len / (1024.0 * 1024.0)) / best);
+    ash_free(text);
+    return 0;
+}
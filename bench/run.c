@@ -0,0 +1,244 @@
+/* Copyright 2018 eomain
+   this program is licensed under the 2-clause BSD license
+   see COPYING for the full license info
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+/*
+runs each workload script with the shell and reports, one line
+per workload, the rate of its ops, the allocations made per op
+and the peak resident size of the shell. a workload reads its
+number of ops from BENCH_OPS; it is also run with none, so that
+startup and parsing are not counted against its ops. the best
+of a number of runs is taken for the times
+
+usage: bench_run <ash> <alloc.so> <dir> [runs]
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define BENCH_RUNS 5
+
+/* the statements repeated to make the script parsed by `parse` */
+static const char *sample =
+    "def greet_{}(name, greeting)\n"
+    "    let message := \"{ $greeting }, { $name }\";\n"
+    "    if [ $name = \"root\" ]\n"
+    "        echo \"welcome back\" $message;\n"
+    "    else\n"
+    "        echo $message | tr a-z A-Z > /dev/null;\n"
+    "    end\n"
+    "    return `$count + 1`;\n"
+    "end\n";
+
+struct workload {
+    const char *name;
+    const char *script;
+    long ops;
+};
+
+static const struct workload workloads[] = {
+    { "fib",        "fib.ash",        200    },
+    { "arith",      "arith.ash",      100000 },
+    { "string",     "string.ash",     5000   },
+    { "collection", "collection.ash", 2000   },
+    { "closure",    "closure.ash",    20000  },
+    { "builtin",    "builtin.ash",    50000  },
+    { "spawn",      "spawn.ash",      500    },
+    /* each op is the scan and parse of one definition */
+    { "parse",      NULL,             20000  }
+};
+
+struct measure {
+    double seconds;
+    double allocs;
+    long rss;
+};
+
+static const char *ash;
+static const char *preload;
+static char alloc_path[] = "/tmp/bench-alloc-XXXXXX";
+
+static double bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static void bench_fail(const char *msg)
+{
+    fprintf(stderr, "bench: %s: %s\n", msg, strerror(errno));
+    exit(1);
+}
+
+/* the allocations made by the process `pid`, as its preload wrote */
+static double bench_allocs(pid_t pid)
+{
+    FILE *file;
+    long p;
+    size_t count, allocs = 0;
+
+    if (!(file = fopen(alloc_path, "r")))
+        return 0;
+    while (fscanf(file, "%ld %zu", &p, &count) == 2) {
+        if (p == (long) pid)
+            allocs = count;
+    }
+    fclose(file);
+    return allocs;
+}
+
+/* run a script once with the given ops, its output is discarded */
+static void bench_exec(const char *script, long ops, struct measure *m)
+{
+    int status;
+    char value[32];
+    double start;
+    pid_t pid;
+    struct rusage ru;
+
+    if (truncate(alloc_path, 0) == -1)
+        bench_fail(alloc_path);
+
+    snprintf(value, sizeof value, "%ld", ops);
+    start = bench_now();
+    if ((pid = fork()) == -1)
+        bench_fail("fork");
+
+    if (pid == 0) {
+        setenv("BENCH_OPS", value, 1);
+        setenv("BENCH_ALLOC", alloc_path, 1);
+        setenv("LD_PRELOAD", preload, 1);
+        /* scripts are parsed on every run */
+        setenv("ASH_CACHE", "", 1);
+        if (!freopen("/dev/null", "w", stdout))
+            _exit(127);
+        execl(ash, ash, "-e", script, (char *) NULL);
+        _exit(127);
+    }
+
+    if (wait4(pid, &status, 0, &ru) == -1)
+        bench_fail("wait");
+    m->seconds = bench_now() - start;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) == 127) {
+        fprintf(stderr, "bench: %s: did not run\n", script);
+        exit(1);
+    }
+    m->allocs = bench_allocs(pid);
+    m->rss = ru.ru_maxrss;
+}
+
+/* the best of a number of runs */
+static void bench_best(const char *script, long ops, int runs,
+                       struct measure *best)
+{
+    struct measure m;
+
+    for (int i = 0; i < runs; ++i) {
+        bench_exec(script, ops, &m);
+        if (i == 0 || m.seconds < best->seconds)
+            best->seconds = m.seconds;
+        if (i == 0 || m.rss > best->rss)
+            best->rss = m.rss;
+        best->allocs = m.allocs;
+    }
+}
+
+/* write a script of `count` definitions to be parsed */
+static void bench_generate(const char *path, long count)
+{
+    FILE *file;
+
+    if (!(file = fopen(path, "w")))
+        bench_fail(path);
+    fputs("def main()\nend\n", file);
+    for (long i = 0; i < count; ++i) {
+        for (const char *s = sample; *s; ++s) {
+            if (s[0] == '{' && s[1] == '}') {
+                fprintf(file, "%ld", i);
+                ++s;
+            } else
+                fputc(*s, file);
+        }
+    }
+    fclose(file);
+}
+
+static void bench_run(const struct workload *w, const char *dir, int runs)
+{
+    long ops = w->ops;
+    double elapsed;
+    char script[4096], empty[4096];
+    struct measure base, full;
+
+    if (w->script) {
+        snprintf(script, sizeof script, "%s/%s", dir, w->script);
+        bench_best(script, 0, runs, &base);
+        bench_best(script, ops, runs, &full);
+    } else {
+        snprintf(empty, sizeof empty, "%s.empty.ash", alloc_path);
+        snprintf(script, sizeof script, "%s.%s.ash", alloc_path, w->name);
+        bench_generate(empty, 0);
+        bench_generate(script, ops);
+        bench_best(empty, 0, runs, &base);
+        bench_best(script, 0, runs, &full);
+        unlink(empty);
+        unlink(script);
+    }
+
+    elapsed = full.seconds - base.seconds;
+    if (elapsed <= 0)
+        elapsed = 1e-9;
+
+    printf("%s ops=%ld seconds=%.6f ops_per_s=%.1f ns_per_op=%.1f "
+           "allocs_per_op=%.2f peak_rss_kb=%ld\n", w->name, ops, elapsed,
+           ops / elapsed, (elapsed * 1e9) / ops,
+           (full.allocs - base.allocs) / ops, full.rss);
+    fflush(stdout);
+}
+
+int main(int argc, const char *argv[])
+{
+    int fd, runs = BENCH_RUNS;
+
+    if (argc < 4) {
+        fprintf(stderr, "usage: bench_run <ash> <alloc.so> <dir> [runs]\n");
+        return 1;
+    }
+
+    ash = argv[1];
+    preload = argv[2];
+    if (argc > 4 && (runs = atoi(argv[4])) < 1)
+        runs = 1;
+
+    if ((fd = mkstemp(alloc_path)) == -1)
+        bench_fail(alloc_path);
+    close(fd);
+
+    for (size_t i = 0; i < sizeof workloads / sizeof *workloads; ++i)
+        bench_run(&workloads[i], argv[3], runs);
+
+    unlink(alloc_path);
+    return 0;
+}
@@ -17,9 +17,14 @@
 #ifndef ASH_COMMAND_H
 #define ASH_COMMAND_H
 
+#include <stdint.h>
+
 #include "ash/obj.h"
+#include "ash/unit.h"
 #include "ash/lang/runtime.h"
 
+extern const struct ash_unit_module ash_module_command;
+
 struct ash_command_env {
     struct ash_runtime_env *env;
     struct ash_obj *result;
@@ -60,6 +65,7 @@ enum ash_command_name {
     ASH_COMMAND_HELP,
     ASH_COMMAND_HISTORY,
     ASH_COMMAND_LIST,
+    ASH_COMMAND_PARALLEL,
     ASH_COMMAND_RAND,
     ASH_COMMAND_READ,
     ASH_COMMAND_SLEEP,
@@ -85,6 +91,25 @@ ash_command_exec(enum ash_command_name,
 extern const char *ash_command_name(enum ash_command_name);
 extern void ash_command_usage(enum ash_command_name);
 
+/* an interned command name along with what it resolves to */
+struct ash_command_entry {
+    const char *name;
+    uint32_t hash;
+    /* the builtin of this name */
+    enum ash_command_name command;
+    /* the name this is an alias of */
+    const char *alias;
+    /* the cached location of an external command */
+    const char *path;
+};
+
+extern struct ash_command_entry *ash_command_lookup(const char *);
+extern struct ash_command_entry *ash_command_intern(const char *);
+
 extern enum ash_command_name ash_command_find(const char *);
+extern enum ash_command_name ash_command_resolve(const char **);
+
+extern const char *ash_command_path(const char *);
+extern void ash_command_path_forget(const char *);
 
 #endif
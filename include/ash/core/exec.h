@@ -38,17 +38,36 @@ enum ash_exec_redirect {
     /* `<` redirect from file */
     ASH_INDIRECTION,
     /* `|>` redirect between commands */
-    ASH_PIPE
+    ASH_PIPE,
+    /* `>>` append to file */
+    ASH_APPEND,
+    /* `>&` duplicate a descriptor */
+    ASH_DUPLICATION,
+    /* `<<<` read from a string */
+    ASH_HERESTRING
+};
+
+/* a redirection of descriptor `fd` applied to a single command */
+struct ash_exec_redirection {
+    enum ash_exec_redirect type;
+    int fd;
+    const char *target;
 };
 
 struct ash_exec_seq {
     struct vec *argv;
+    struct vec *io;
     enum ash_exec_redirect redirect;
 };
 
 struct ash_runtime_env;
 extern int ash_exec_pipeline(struct vec *, struct ash_runtime_env *);
-extern int ash_exec_command(struct vec *, struct ash_runtime_env *);
+extern int ash_exec_command(struct vec *, struct vec *, struct ash_runtime_env *);
 extern int ash_exec_set_path(void);
 
+/* run a function in a forked subshell with its output on a pipe */
+extern int ash_exec_subshell(void (*)(void *), void *, int *);
+extern int ash_exec_subshell_wait(int);
+extern char *ash_exec_capture(void (*)(void *), void *, size_t *);
+
 #endif
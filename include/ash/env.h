@@ -54,8 +54,8 @@ extern const char *ash_env_get_greeter(void);
 extern void ash_env_prompt_default(void);
 
 extern void ash_env_profile(void);
-extern void ash_prompt(void);
-extern void ash_prompt_next(void);
+extern const char *ash_prompt(void);
+extern const char *ash_prompt_next(void);
 extern void ash_env_init(void);
 extern size_t ash_env_get_pwd_max(void);
 extern void ash_env_pwd(void);
@@ -27,7 +27,9 @@
 extern const struct ash_unit_module ash_module_io;
 
 extern const char *ash_io_read(const char *);
+extern char *ash_io_read_fd(int, size_t *);
 extern void ash_io_silent(bool);
+extern void ash_io_unbuffered(bool);
 
 extern const char *ash_scan(const char *);
 extern const char *ash_scan_prompt(const char *);
@@ -25,6 +25,18 @@
 #include "ash/core/exec.h"
 #include "ash/lang/lang.h"
 
+/*
+the nodes of a statement are allocated together from a pool,
+in the order they are parsed, and are released all at once.
+nodes are created in the pool last passed to ast_pool_use
+*/
+struct ast_pool;
+
+extern struct ast_pool *ast_pool_new(void);
+extern struct ast_pool *ast_pool_use(struct ast_pool *);
+extern void ast_pool_destroy(struct ast_pool *);
+extern char *ast_strdup(const char *, size_t);
+
 struct ast_scope {
     const char *id;
     struct ast_scope *next;
@@ -231,6 +243,22 @@ struct ast_hash {
 extern struct ast_hash *
 ast_hash_new(const char *, struct ast_expr *);
 
+struct ast_stm;
+
+struct ast_subst {
+    enum ast_subst_type {
+        /* `$(...)` captured as a string */
+        AST_SUBST_STRING,
+        /* `$<(...)` iterated line by line */
+        AST_SUBST_LINES
+    } type;
+
+    struct ast_stm *stm;
+};
+
+extern struct ast_subst *
+ast_subst_new(enum ast_subst_type, struct ast_stm *);
+
 struct ast_expr {
     enum ast_expr_type {
         AST_EXPR_VALUE,
@@ -242,6 +270,7 @@ struct ast_expr {
         AST_EXPR_TERNARY,
         AST_EXPR_MATCH,
         AST_EXPR_HASH,
+        AST_EXPR_SUBST,
     } type;
 
     void *expr;
@@ -277,26 +306,42 @@ struct ast_stm {
     } type;
 
     struct ast_stm *next;
+    /* the pool the statement was parsed into */
+    struct ast_pool *pool;
+    /* the line of the source the statement begins on */
+    size_t line;
 };
 
-extern struct ast_stm *ast_stm_new(enum ast_node_type, void *);
+extern struct ast_stm *ast_stm_new(enum ast_node_type, void *, size_t);
+extern void ast_stm_destroy(struct ast_stm *);
 
 struct ast_command_redirect {
     enum ash_exec_redirect type;
     struct ast_command *command;
 };
 
-extern struct ast_command_redirect
+extern struct ast_command_redirect *
 ast_command_redirect_new(enum ash_exec_redirect, struct ast_command *);
 
+struct ast_io {
+    enum ash_exec_redirect type;
+    int fd;
+    struct ast_expr *expr;
+    struct ast_io *next;
+};
+
+extern struct ast_io *ast_io_new(enum ash_exec_redirect, int, struct ast_expr *);
+
 struct ast_command {
     struct ast_expr *expr;
     size_t length;
+    struct ast_io *io;
     struct ast_command_redirect *redirect;
 };
 
 extern struct ast_command *
-ast_command_new(struct ast_expr *, size_t);
+ast_command_new(struct ast_expr *, size_t, struct ast_io *);
+extern void ast_command_pipe(struct ast_command *, struct ast_command *);
 
 struct ast_call {
     struct ast_var *var;
@@ -0,0 +1,46 @@
+/* Copyright 2018 eomain
+   this program is licensed under the 2-clause BSD license
+   see COPYING for the full license info
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef ASH_LANG_CACHE_H
+#define ASH_LANG_CACHE_H
+
+#include "ash/script.h"
+#include "ash/type.h"
+#include "ash/lang/ast.h"
+
+/*
+the directory holding parsed scripts, when unset it is
+$XDG_CACHE_HOME/ash or ~/.cache/ash; empty disables the cache
+*/
+#define ASH_CACHE_ENV "ASH_CACHE"
+
+struct cache;
+struct cache_writer;
+
+/* the cached statements of a script, or NULL when there are none */
+extern struct cache *cache_load(struct script *);
+/* the next statement, returns 1 for a statement, 0 at the end, -1 on error */
+extern int cache_next(struct cache *, struct ast_stm **, bool *);
+extern void cache_close(struct cache *);
+
+/* a writer for the statements of a script, or NULL when not cached */
+extern struct cache_writer *cache_writer_new(struct script *);
+extern void cache_writer_add(struct cache_writer *, struct ast_stm *, bool);
+/* replace the cache once the whole script has been written */
+extern int cache_writer_commit(struct cache_writer *);
+extern void cache_writer_destroy(struct cache_writer *);
+
+#endif
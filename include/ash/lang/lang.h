@@ -18,6 +18,7 @@
 #define ASH_LANG_LANG_H
 
 #include <stddef.h>
+#include <string.h>
 
 #include "ash/ash.h"
 #include "ash/script.h"
@@ -68,6 +69,13 @@ static inline const char *input_text_content(struct input *input)
     return content;
 }
 
+static inline size_t input_text_length(struct input *input)
+{
+    if (input->type == ASH_INPUT_SCRIPT)
+        return ash_script_length(input->method.script);
+    return strlen(input->method.text);
+}
+
 static inline const char *input_get_name(struct input *input)
 {
     if (input->type == ASH_INPUT_SCRIPT)
@@ -142,6 +150,10 @@ enum ash_tk_type {
     RB_TK,
     /* backquote */
     BQ_TK,
+    /* command substitution `$(...)` */
+    CS_TK,
+    /* line-wise command substitution `$<(...)` */
+    CSL_TK,
     /* true */
     TR_TK,
     /* false */
@@ -160,6 +172,16 @@ enum ash_tk_type {
     FOR_TK,
     /* pipe */
     PIP_TK,
+    /* `>` redirect output */
+    RDO_TK,
+    /* `>>` redirect and append output */
+    RDA_TK,
+    /* `<` redirect input */
+    RDI_TK,
+    /* `>&` duplicate a descriptor */
+    RDD_TK,
+    /* `<<<` here-string */
+    RDS_TK,
     /* end */
     END_TK,
     /* def */
@@ -190,63 +212,96 @@ enum ash_tk_type {
     RET_TK
 };
 
-struct ash_tk {
-    enum ash_tk_type type;
-    bool eos;
-    size_t line;
-    size_t offset;
-    const char *str;
-    struct ash_tk *next;
-};
+/* the token is followed by the end of a statement */
+#define ASH_TK_EOS (0x01)
+/* the token has a string, a view of the input */
+#define ASH_TK_STR (0x02)
 
-struct ash_tk_meta {
-    size_t line;
-    size_t offset;
+/*
+tokens are held by value in the array of a set; the string
+of a token is found by its offset into the text of the set
+*/
+struct ash_tk {
+    uint8_t type;
+    uint8_t flags;
+    uint32_t line;
+    uint32_t offset;
+    uint32_t len;
 };
 
-static inline void ash_tk_meta_init(struct ash_tk_meta *meta,
-                                    size_t line, size_t offset)
-{
-    meta->line = line;
-    meta->offset = offset;
-}
-
-extern enum ash_tk_type ash_tk_get(struct ash_tk **);
-extern struct ash_tk *ash_tk_next(struct ash_tk **);
-extern enum ash_tk_type ash_tk_cknext(struct ash_tk **);
-extern bool ash_tk_eos(struct ash_tk **);
-extern bool ash_tk_get_eos(struct ash_tk **);
-extern const char *ash_tk_strcpy(struct ash_tk **);
-extern isize ash_tk_num(struct ash_tk **);
 extern const char *ash_tk_name(enum ash_tk_type);
-extern int ash_tk_assert_type(struct ash_tk **, enum ash_tk_type);
 
+struct lexer;
+
+/*
+tokens are indexed from the first added to the set; those in
+front of `base` have been released and are no longer held
+*/
 struct ash_tk_set {
-    struct ash_tk *front;
-    struct ash_tk *rear;
+    struct ash_tk *tokens;
+    size_t base;
+    size_t count;
+    size_t size;
+    /* the text the tokens refer to */
+    const char *text;
+    size_t length;
+    /* the text once extended, which is owned by the set */
+    char *buffer;
+    /* when set, the tokens are scanned on demand */
+    struct lexer *lexer;
 };
 
 static inline void ash_tk_set_init(struct ash_tk_set *set)
 {
-    set->front = NULL;
-    set->rear = NULL;
+    set->tokens = NULL;
+    set->base = 0;
+    set->count = 0;
+    set->size = 0;
+    set->text = NULL;
+    set->length = 0;
+    set->buffer = NULL;
+    set->lexer = NULL;
 }
 
 static inline bool ash_tk_set_empty(struct ash_tk_set *set)
 {
-    return (!set->front) ? true: false;
+    return (!set->count) ? true: false;
+}
+
+/* the index following the last token of the set */
+static inline size_t ash_tk_set_end(struct ash_tk_set *set)
+{
+    return set->base + set->count;
+}
+
+static inline struct ash_tk *
+ash_tk_set_get(struct ash_tk_set *set, size_t index)
+{
+    if (index < set->base || index >= ash_tk_set_end(set))
+        return NULL;
+    return &set->tokens[index - set->base];
 }
 
 static inline void ash_tk_set_eos(struct ash_tk_set *set)
 {
-    if (set->rear && !set->rear->eos)
-        set->rear->eos = true;
+    if (set->count)
+        set->tokens[set->count - 1].flags |= ASH_TK_EOS;
 }
 
-extern void ash_tk_set_add(struct ash_tk_set *, enum ash_tk_type,
-                           const char *, struct ash_tk_meta *);
+/* the string of a token, which is not terminated */
+static inline const char *
+ash_tk_set_str(struct ash_tk_set *set, struct ash_tk *tk)
+{
+    return (tk->flags & ASH_TK_STR) ? set->text + tk->offset: NULL;
+}
 
-extern struct ash_tk *ash_tk_set_front(struct ash_tk_set *);
+extern void ash_tk_set_add(struct ash_tk_set *, enum ash_tk_type, uint8_t,
+                           size_t, size_t, size_t);
+extern isize ash_tk_set_num(struct ash_tk_set *, struct ash_tk *);
+extern size_t ash_tk_set_column(struct ash_tk_set *, size_t);
+extern const char *ash_tk_set_extend(struct ash_tk_set *, const char *, size_t);
+extern void ash_tk_set_release(struct ash_tk_set *, size_t);
+extern void ash_tk_set_destroy(struct ash_tk_set *);
 
 extern int ash_lang_prompt(struct ash_tk_set *, enum input_prompt_type);
 
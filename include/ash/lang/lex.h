@@ -19,6 +19,10 @@
 
 #include "ash/lang/lang.h"
 
-extern int lex_scan_input(struct ash_tk_set *, const char *);
+extern int lex_scan_input(struct ash_tk_set *, const char *, size_t);
+
+extern struct lexer *lex_stream_new(struct ash_tk_set *, const char *, size_t);
+extern int lex_stream_next(struct lexer *);
+extern void lex_stream_destroy(struct lexer *);
 
 #endif
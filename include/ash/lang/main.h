@@ -22,4 +22,10 @@
 extern void ash_main(void);
 extern int  ash_main_input(struct input *);
 
+struct ash_main_parsed;
+
+extern struct ash_main_parsed *ash_main_parse_ahead(struct input *);
+extern int  ash_main_parsed_exec(struct ash_main_parsed *);
+extern void ash_main_parsed_destroy(struct ash_main_parsed *);
+
 #endif
@@ -23,6 +23,8 @@
 struct parser_meta {
     struct input *input;
     struct ash_tk_set *set;
+    /* syntax errors are not reported */
+    bool quiet;
 };
 
 static inline void
@@ -31,8 +33,16 @@ parser_meta_init(struct parser_meta *meta, struct input *input,
 {
     meta->input = input;
     meta->set = set;
+    meta->quiet = false;
 }
 
 extern int parser_ast_construct(struct ast_prog *, struct parser_meta *);
 
+struct parser;
+
+extern struct parser *parser_new(struct parser_meta *);
+extern int parser_ast_next(struct parser *, struct ast_stm **, bool *);
+extern void parser_quiet(struct parser *);
+extern void parser_destroy(struct parser *);
+
 #endif
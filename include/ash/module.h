@@ -70,6 +70,30 @@ ash_module_path(struct ash_module *,
 extern struct ash_module *
 ash_module_root(void);
 
+/* the file a module was loaded from, as it was when loaded */
+struct ash_module_file {
+    isize mtime;
+    isize mtime_nsec;
+    usize size;
+    usize ino;
+};
+
+static inline bool
+ash_module_file_eq(struct ash_module_file *a, struct ash_module_file *b)
+{
+    return (a->mtime == b->mtime && a->mtime_nsec == b->mtime_nsec &&
+            a->size == b->size && a->ino == b->ino) ? true: false;
+}
+
+extern bool
+ash_module_loaded(const char *, struct ash_module_file *);
+
+extern void
+ash_module_load(const char *, struct ash_module_file *);
+
+extern void
+ash_module_unload(const char *);
+
 struct map;
 
 extern struct ash_var *
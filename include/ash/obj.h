@@ -75,6 +75,8 @@ struct ash_obj {
     struct ash_obj *ref;
     bool bound;
     bool mutable;
+    /* changed in place by the iterator that yields it */
+    bool reused;
     usize rc;
     struct ash_obj *string;
 };
@@ -96,6 +98,7 @@ extern bool ash_obj_nil(struct ash_obj *);
 extern bool ash_obj_eq(struct ash_obj *, struct ash_obj *);
 extern bool ash_obj_type_eq(struct ash_obj *, struct ash_obj *);
 extern bool ash_obj_has_bind(struct ash_obj *);
+extern struct ash_obj *ash_obj_keep(struct ash_obj *);
 extern void ash_obj_inc_rc(struct ash_obj *);
 extern void ash_obj_dec_rc(struct ash_obj *);
 extern usize ash_obj_get_rc(struct ash_obj *);
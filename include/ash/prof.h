@@ -0,0 +1,90 @@
+/* Copyright 2019 eomain
+   this program is licensed under the 2-clause BSD license
+   see COPYING for the full license info
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef ASH_PROF_H
+#define ASH_PROF_H
+
+#include <signal.h>
+#include <stddef.h>
+
+#include "ash/ash.h"
+#include "ash/type.h"
+
+/* the long option writing a profile of a script */
+#define ASH_PROF_OPTION "profile"
+
+/* a function or script on the ash call stack */
+struct ash_prof_frame {
+    const char *name;
+    /* the line of the statement being run */
+    size_t line;
+    struct ash_prof_frame *prev;
+};
+
+/* the innermost frame while profiling, otherwise NULL */
+extern struct ash_prof_frame *ash_prof_top;
+/* timer ticks not yet taken as a sample */
+extern volatile sig_atomic_t ash_prof_ticks;
+
+extern void ash_prof_start(const char *);
+extern void ash_prof_sample(void);
+
+/*
+the ticks since the last safe point are sampled on the stack as
+it was before a frame is pushed or popped, so that the time of
+the last statement of a call, and of the builtin or foreign
+function it ran, is charged to the frame that ran it
+*/
+static inline void
+ash_prof_push(struct ash_prof_frame *frame, const char *name)
+{
+    if (!ash_prof_top)
+        return;
+    if (ash_prof_ticks)
+        ash_prof_sample();
+    frame->name = name;
+    frame->line = 0;
+    frame->prev = ash_prof_top;
+    ash_prof_top = frame;
+}
+
+static inline void
+ash_prof_pop(struct ash_prof_frame *frame)
+{
+    if (ash_prof_top == frame) {
+        if (ash_prof_ticks)
+            ash_prof_sample();
+        ash_prof_top = frame->prev;
+    }
+}
+
+/*
+the safe point of the profiler, reached before each statement:
+the ticks since the last are sampled on the stack as it was,
+then the innermost frame moves on to the line of the statement
+*/
+static inline void
+ash_prof_line(size_t line)
+{
+    if (ash_prof_top) {
+        if (ash_prof_ticks)
+            ash_prof_sample();
+        ash_prof_top->line = line;
+    }
+}
+
+#endif
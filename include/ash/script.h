@@ -38,8 +38,13 @@ extern void ash_script_meta_set(struct script_meta *);
 struct file {
     const char *path;
     const char *name;
+    /* the contents, not terminated when mapped */
     const char *text;
     size_t length;
+    bool mapped;
+    /* modification time when opened */
+    isize mtime;
+    isize mtime_nsec;
 };
 
 struct script {
@@ -54,11 +59,16 @@ struct script {
 
 extern struct script *ash_script_open(const char *, bool);
 extern int ash_script_load(const char *, bool);
+extern int ash_script_require(const char *, bool);
+/* scripts of a batch are parsed in parallel and run in order */
+extern int ash_script_load_all(size_t, const char * const *);
+extern isize ash_script_require_all(size_t, const char * const *, bool);
 extern void ash_script_close(struct script *);
 extern int ash_script_exec(struct script *);
 extern int ash_script_exec_entry(struct script *, struct ash_obj *);
 extern const char *ash_script_name(struct script *);
 extern const char *ash_script_content(struct script *);
+extern size_t ash_script_length(struct script *);
 
 /*
   load and execute the ash_profile script
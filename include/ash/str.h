@@ -26,6 +26,8 @@
 extern struct ash_obj *ash_str_new(void);
 extern void ash_str_set(struct ash_obj *, const char *);
 extern struct ash_obj *ash_str_from(const char *);
+extern struct ash_obj *ash_str_from_len(const char *, size_t);
+extern size_t ash_str_len(struct ash_obj *);
 extern const char *ash_str_get(struct ash_obj *);
 
 #endif
@@ -20,8 +20,14 @@
 #include "ash/ash.h"
 #include "ash/unit.h"
 
+/* the history file, when unset it is ~/.ash_history */
+#define ASH_HISTORY_ENV "ASH_HISTORY"
+/* the number of lines of history kept, when unset it is 500 */
+#define ASH_HISTORY_SIZE_ENV "ASH_HISTORY_SIZE"
+
 extern const struct ash_unit_module ash_module_term;
 
+extern void ash_term_open(void);
 extern const char *ash_term_get(const char *);
 extern const char *ash_term_get_raw(const char *);
 extern const char *ash_term_get_default(void);
@@ -0,0 +1,62 @@
+/* Copyright 2019 eomain
+   this program is licensed under the 2-clause BSD license
+   see COPYING for the full license info
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef ASH_TRACE_H
+#define ASH_TRACE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "ash/ash.h"
+#include "ash/type.h"
+
+/* the long option tracing commands and calls to a descriptor */
+#define ASH_TRACE_OPTION "xtrace"
+
+/* the status of a traced call that has none */
+#define ASH_TRACE_NO_STATUS (-1)
+
+enum ash_trace_kind {
+    ASH_TRACE_COMMAND = 'c',
+    ASH_TRACE_BUILTIN = 'b',
+    ASH_TRACE_FUNC    = 'f'
+};
+
+extern bool ash_trace_enabled;
+
+extern int ash_trace_start(const char *);
+extern uint64_t ash_trace_clock(void);
+extern void ash_trace_record(enum ash_trace_kind, const char *,
+                             uint64_t, int, pid_t);
+extern void ash_trace_flush(void);
+
+/* the time a traced span begins, 0 when not tracing */
+static inline uint64_t ash_trace_now(void)
+{
+    return ash_trace_enabled ? ash_trace_clock(): 0;
+}
+
+/* a span from `start` until now; a pid of 0 is the shell */
+static inline void
+ash_trace(enum ash_trace_kind kind, const char *name, uint64_t start,
+          int status, pid_t pid)
+{
+    if (ash_trace_enabled)
+        ash_trace_record(kind, name, start, status, pid);
+}
+
+#endif
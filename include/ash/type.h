@@ -17,6 +17,7 @@
 #ifndef ASH_TYPE_H
 #define ASH_TYPE_H
 
+#include <limits.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -28,6 +29,8 @@ typedef unsigned char ubyte;
 
 typedef ubyte bool;
 
+#define ISIZE_MAX LONG_MAX
+
 typedef uint32_t uchar;
 
 #define true  1
@@ -0,0 +1,39 @@
+/* Copyright 2018 eomain
+   this program is licensed under the 2-clause BSD license
+   see COPYING for the full license info
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef ASH_TYPE_BYTES_H
+#define ASH_TYPE_BYTES_H
+
+#include <stddef.h>
+
+#include "ash/obj.h"
+#include "ash/type.h"
+
+/* create bytes holding `len` bytes of `data`, taking ownership */
+extern struct ash_obj *ash_bytes_new(char *, size_t);
+/* create bytes from a copy of `len` bytes of `data` */
+extern struct ash_obj *ash_bytes_from(const char *, size_t);
+/* a view of `len` bytes at `offset`, sharing the storage of `obj` */
+extern struct ash_obj *ash_bytes_slice(struct ash_obj *, size_t, size_t);
+/* the start of the bytes, or NULL when `obj` is not bytes */
+extern const char *ash_bytes_get(struct ash_obj *);
+extern size_t ash_bytes_len(struct ash_obj *);
+/* read up to `count` bytes from a descriptor, or until the end when < 0 */
+extern struct ash_obj *ash_bytes_read(int, isize);
+/* write all `len` bytes of `data` to a descriptor, false on error */
+extern bool ash_bytes_write(int, const char *, size_t);
+
+#endif
@@ -21,7 +21,7 @@
 
 #include "ash/obj.h"
 
-struct rc *rc;
+struct rc;
 
 extern struct rc *rc_new(void *, void (*)(void *));
 extern void rc_destroy(struct rc *);
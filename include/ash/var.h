@@ -26,6 +26,9 @@
 
 struct ash_var;
 
+/* computes the value of a variable when it is first read */
+typedef struct ash_obj *(*ash_var_lazy)(void);
+
 extern struct ash_var *ash_var_new(const char *);
 extern struct ash_obj *ash_var_obj(struct ash_var *);
 extern void ash_var_destroy(struct ash_var *);
@@ -41,6 +44,7 @@ extern struct ash_var *ash_var_get(const char *);
 extern void ash_var_unset(struct ash_var *);
 
 extern struct ash_var *ash_var_set_override(const char *, struct ash_obj *);
+extern struct ash_var *ash_var_set_lazy(const char *, ash_var_lazy);
 
 extern struct ash_var *ash_var_func_set(const char *, struct ash_obj *);
 extern struct ash_var *ash_var_func_get(const char *);